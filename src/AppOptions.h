@@ -0,0 +1,192 @@
+#pragma once
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+// How frames reach the screen, see createSwapChain()
+enum class PresentPolicy {
+    Fifo,        // Vsync, blocks when the queue is full: lowest power, the only mode every device supports
+    FifoRelaxed, // Vsync, but a late frame is shown at once (may tear) instead of waiting for the next vblank
+    Mailbox,     // Vsync without blocking, queued frames are replaced by newer ones: low latency, full GPU load
+    Immediate,   // No vsync, tears
+    Uncapped     // Whatever presents fastest (IMMEDIATE, then MAILBOX) and no frame limiter, for benchmarks
+};
+
+inline bool parsePresentPolicy(const char* name, PresentPolicy& policy) {
+    if (strcmp(name, "fifo") == 0) policy = PresentPolicy::Fifo;
+    else if (strcmp(name, "fifo-relaxed") == 0) policy = PresentPolicy::FifoRelaxed;
+    else if (strcmp(name, "mailbox") == 0) policy = PresentPolicy::Mailbox;
+    else if (strcmp(name, "immediate") == 0) policy = PresentPolicy::Immediate;
+    else if (strcmp(name, "uncapped") == 0) policy = PresentPolicy::Uncapped;
+    else return false;
+    return true;
+}
+
+// How triangle.frag colors the instances, a specialization constant (SHADING_MODEL) of the graphics pipeline
+enum class ShadingModel : uint32_t {
+    VertexColor, // Vertex colors times the instance color
+    Solid,       // One constant color
+    Grayscale,   // Luminance of the vertex color
+    Count
+};
+
+inline bool parseShadingModel(const char* name, ShadingModel& model) {
+    if (strcmp(name, "vertex") == 0) model = ShadingModel::VertexColor;
+    else if (strcmp(name, "solid") == 0) model = ShadingModel::Solid;
+    else if (strcmp(name, "grayscale") == 0) model = ShadingModel::Grayscale;
+    else return false;
+    return true;
+}
+
+// Runtime switches parsed from the command line
+struct AppOptions {
+    bool headless = false; // Render into offscreen images instead of a window swap chain
+    uint32_t headlessFrameCount = 1000; // Frames to render before exiting when there is no window to close
+    uint32_t framesInFlight = 2; // Frames the CPU may record ahead of the GPU, more means throughput, fewer means latency
+    uint32_t recordThreads = 0; // Worker threads recording the draws into secondary command buffers, 0 records on the main thread
+    uint32_t drawCount = 1; // Draw calls per frame, raise it to load the CPU side of recording
+    uint32_t instanceCount = 1; // Triangles drawn per frame, split evenly over the draw calls
+    bool gpuCulling = false; // Cull the instances in a compute pass and draw the survivors with one instanced vkCmdDrawIndexedIndirect
+    bool asyncCompute = true; // Run compute passes on a dedicated compute queue when the device has one
+    std::string device; // Device override: enumeration index, device UUID (prefix) or part of the name, see DeviceSelector.h
+    bool listDevices = false; // Print every device with its score or what it lacks, then exit
+    PresentPolicy presentPolicy = PresentPolicy::Mailbox; // Falls back to FIFO when the surface lacks the mode
+    double frameRateLimit = 0.0; // CPU side frame cap in frames per second, 0 is no cap, ignored when uncapped
+    float statsInterval = 0.0f; // Seconds between frame timing summaries, 0 only prints them on exit
+    std::string pipelineCachePath = "pipeline_cache.bin"; // Empty disables the on-disk pipeline cache
+    bool pipelineLibrary = true; // Link pipeline variants from VK_EXT_graphics_pipeline_library parts when the device supports it
+    std::string shaderDirectory; // Development override: load "<dir>/<name>.spv" instead of the embedded SPIR-V
+    bool hotReload = false; // Rebuild pipelines in the background when their shader files change, see ShaderHotReload.h
+    ShadingModel shadingModel = ShadingModel::VertexColor; // Initial variant, M cycles it at runtime
+    bool animate = false; // Spin the instances in the vertex shader, A toggles it at runtime
+#ifdef RUNTIME_SHADER_COMPILER
+    std::string shaderSourceDirectory = SHADER_SOURCE_DIR; // GLSL compiled in-process by development builds
+    std::string shaderCacheDirectory = "shader_cache"; // Content addressed SPIR-V cache of the in-process compiler
+#endif
+};
+
+inline void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+        << "  --headless                Render offscreen without a window, surface or swap chain\n"
+        << "  --frames <n>              Frames to render in headless mode (default 1000)\n"
+        << "  --frames-in-flight <n>    Frames the CPU may get ahead of the GPU, 1 to 4 (default 2)\n"
+        << "  --record-threads <n>      Record draws on <n> worker threads (default 0: main thread only)\n"
+        << "  --draws <n>               Draw calls per frame, to stress command recording (default 1)\n"
+        << "  --instances <n>           Instanced triangles per frame, 1 to 10000000 (default 1)\n"
+        << "  --gpu-culling             Frustum cull the instances on the GPU and draw them indirectly\n"
+        << "  --no-async-compute        Record compute passes on the graphics queue even if a compute queue exists\n"
+        << "  --device <id>             Use the device with this index, UUID or name part (also VULKANAPP_DEVICE)\n"
+        << "  --list-devices            List the devices, their scores and missing requirements, then exit\n"
+        << "  --present <mode>          fifo, fifo-relaxed, mailbox, immediate or uncapped (default mailbox)\n"
+        << "  --fps-limit <n>           Cap the frame rate on the CPU at <n> frames per second (default 0: no cap)\n"
+        << "  --stats-interval <s>      Print frame timing summaries every <s> seconds (default: on exit only)\n"
+        << "  --pipeline-cache <path>   Pipeline cache file (default pipeline_cache.bin)\n"
+        << "  --no-pipeline-cache       Do not load or save the pipeline cache\n"
+        << "  --no-pipeline-library     Build complete pipelines even if VK_EXT_graphics_pipeline_library is supported\n"
+        << "  --shader-dir <dir>        Load SPIR-V from <dir> instead of the embedded shaders\n"
+        << "  --hot-reload              Rebuild pipelines when the shader dir (or GLSL sources) change\n"
+        << "  --shading <model>         vertex, solid or grayscale (default vertex), M cycles it in the window\n"
+        << "  --animate                 Spin the instances, A toggles it in the window\n"
+#ifdef RUNTIME_SHADER_COMPILER
+        << "  --shader-cache <dir>      SPIR-V cache of the in-process shader compiler (default shader_cache)\n"
+#endif
+        << "  --help                    Show this message\n";
+}
+
+// Returns false if the program should exit (bad argument or --help)
+inline bool parseArguments(int argc, char** argv, AppOptions& options) {
+    if (const char* shaderDirectory = getenv("VULKANAPP_SHADER_DIR")) options.shaderDirectory = shaderDirectory;
+    if (const char* device = getenv("VULKANAPP_DEVICE")) options.device = device;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        auto nextValue = [&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; };
+
+        if (strcmp(arg, "--headless") == 0) options.headless = true;
+        else if (strcmp(arg, "--frames") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --frames\n"; return false; }
+            options.headlessFrameCount = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        else if (strcmp(arg, "--frames-in-flight") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --frames-in-flight\n"; return false; }
+            options.framesInFlight = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        else if (strcmp(arg, "--record-threads") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --record-threads\n"; return false; }
+            options.recordThreads = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        else if (strcmp(arg, "--draws") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --draws\n"; return false; }
+            options.drawCount = std::max<uint32_t>(1, static_cast<uint32_t>(strtoul(value, nullptr, 10)));
+        }
+        else if (strcmp(arg, "--instances") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --instances\n"; return false; }
+            options.instanceCount = std::clamp<uint32_t>(static_cast<uint32_t>(strtoul(value, nullptr, 10)), 1, 10'000'000);
+        }
+        else if (strcmp(arg, "--gpu-culling") == 0) options.gpuCulling = true;
+        else if (strcmp(arg, "--no-async-compute") == 0) options.asyncCompute = false;
+        else if (strcmp(arg, "--device") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --device\n"; return false; }
+            options.device = value;
+        }
+        else if (strcmp(arg, "--list-devices") == 0) options.listDevices = true;
+        else if (strcmp(arg, "--present") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --present\n"; return false; }
+            if (!parsePresentPolicy(value, options.presentPolicy)) { std::cerr << "Unknown present mode: " << value << "\n"; return false; }
+        }
+        else if (strcmp(arg, "--fps-limit") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --fps-limit\n"; return false; }
+            options.frameRateLimit = std::max(0.0, strtod(value, nullptr));
+        }
+        else if (strcmp(arg, "--stats-interval") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --stats-interval\n"; return false; }
+            options.statsInterval = strtof(value, nullptr);
+        }
+        else if (strcmp(arg, "--pipeline-cache") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --pipeline-cache\n"; return false; }
+            options.pipelineCachePath = value;
+        }
+        else if (strcmp(arg, "--no-pipeline-cache") == 0) options.pipelineCachePath.clear();
+        else if (strcmp(arg, "--no-pipeline-library") == 0) options.pipelineLibrary = false;
+        else if (strcmp(arg, "--shader-dir") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --shader-dir\n"; return false; }
+            options.shaderDirectory = value;
+        }
+        else if (strcmp(arg, "--hot-reload") == 0) options.hotReload = true;
+        else if (strcmp(arg, "--shading") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --shading\n"; return false; }
+            if (!parseShadingModel(value, options.shadingModel)) { std::cerr << "Unknown shading model: " << value << "\n"; return false; }
+        }
+        else if (strcmp(arg, "--animate") == 0) options.animate = true;
+#ifdef RUNTIME_SHADER_COMPILER
+        else if (strcmp(arg, "--shader-cache") == 0) {
+            const char* value = nextValue();
+            if (!value) { std::cerr << "Missing value for --shader-cache\n"; return false; }
+            options.shaderCacheDirectory = value;
+        }
+#endif
+        else if (strcmp(arg, "--help") == 0) { printUsage(argv[0]); return false; }
+        else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+
+/*
+    Barrier batching (synchronization2)
+    Every image remembers the layout it is in and the stages/accesses of its last use. A transition then only has to
+    name where the image goes next: the source half of the barrier comes from the tracked state, so it is exactly as
+    narrow as the previous use instead of a conservative TOP_OF_PIPE/BOTTOM_OF_PIPE.
+
+    Transitions are only collected, flush() records all of them with a single vkCmdPipelineBarrier2 at the
+    pass boundary, and read after read in the same layout needs no barrier at all.
+
+    Buffers are not tracked: there are few of them and a global memory barrier costs the same as a buffer barrier
+    on every driver, so memoryBarrier() merges all buffer hazards of a pass boundary into one VkMemoryBarrier2.
+
+    Usage while recording:
+        barriers.setState(image, { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE });
+        barriers.transition(image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
+        barriers.flush(cmd);
+        ... pass ...
+
+    Not thread safe, the state is for one command buffer recorded in submission order.
+*/
+class BarrierBatch {
+public:
+    struct ImageState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+    };
+
+private:
+    static constexpr VkAccessFlags2 WRITE_ACCESS =
+        VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+        VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+    struct TrackedImage {
+        VkImage image;
+        VkImageAspectFlags aspect;
+        ImageState state;
+        int pending; // Index into pendingImages, -1 if no transition is waiting for flush()
+    };
+
+    std::vector<TrackedImage> images; // A handful per frame, a linear search beats hashing
+    std::vector<VkImageMemoryBarrier2> pendingImages;
+    VkMemoryBarrier2 pendingMemory{ VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 }; // Empty while all stage masks are NONE
+
+    TrackedImage& find(VkImage image, VkImageAspectFlags aspect) {
+        for (auto& tracked : this->images)
+            if (tracked.image == image) return tracked;
+        this->images.push_back({ image, aspect, ImageState{}, -1 });
+        return this->images.back();
+    }
+
+public:
+    // Declares the state of an image before anything is recorded for it in this command buffer,
+    // e.g. a swap chain image right after acquire (contents undefined, available once the acquire semaphore wait stage is reached)
+    void setState(VkImage image, const ImageState& state, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT) {
+        TrackedImage& tracked = find(image, aspect);
+        tracked.aspect = aspect;
+        tracked.state = state;
+    }
+
+    const ImageState* state(VkImage image) const {
+        for (const auto& tracked : this->images)
+            if (tracked.image == image) return &tracked.state;
+        return nullptr;
+    }
+
+    // The image is about to be used in the given layout, stages and accesses
+    void transition(VkImage image, VkImageLayout layout, VkPipelineStageFlags2 stages, VkAccessFlags2 access) {
+        TrackedImage& tracked = find(image, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        // Read after read in the same layout: no hazard, but later writes must also wait for these readers
+        bool writes = (tracked.state.access | access) & WRITE_ACCESS;
+        if (tracked.pending < 0 && tracked.state.layout == layout && !writes) {
+            tracked.state.stages |= stages;
+            tracked.state.access |= access;
+            return;
+        }
+
+        // Nothing was recorded since the previous transition of this image, so the two collapse into one
+        if (tracked.pending >= 0) {
+            VkImageMemoryBarrier2& barrier = this->pendingImages[tracked.pending];
+            barrier.newLayout = layout;
+            barrier.dstStageMask = stages;
+            barrier.dstAccessMask = access;
+        }
+        else {
+            VkImageMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = tracked.state.stages;
+            barrier.srcAccessMask = tracked.state.access & WRITE_ACCESS; // Only writes need to be made available
+            barrier.dstStageMask = stages;
+            barrier.dstAccessMask = access;
+            barrier.oldLayout = tracked.state.layout;
+            barrier.newLayout = layout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = image;
+            barrier.subresourceRange = { tracked.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+            tracked.pending = static_cast<int>(this->pendingImages.size());
+            this->pendingImages.push_back(barrier);
+        }
+
+        tracked.state = { layout, stages, access };
+    }
+
+    // Buffer hazard, e.g. a compute shader writing what an indirect draw reads next. srcAccess only lists writes to make available,
+    // NONE for a pure execution dependency (write after read)
+    void memoryBarrier(VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess) {
+        this->pendingMemory.srcStageMask |= srcStages;
+        this->pendingMemory.srcAccessMask |= srcAccess;
+        this->pendingMemory.dstStageMask |= dstStages;
+        this->pendingMemory.dstAccessMask |= dstAccess;
+    }
+
+    // Records every pending transition with one vkCmdPipelineBarrier2, call at pass boundaries
+    void flush(VkCommandBuffer commandBuffer) {
+        bool memory = this->pendingMemory.srcStageMask != VK_PIPELINE_STAGE_2_NONE;
+        if (this->pendingImages.empty() && !memory) return;
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.memoryBarrierCount = memory ? 1 : 0;
+        dependencyInfo.pMemoryBarriers = &this->pendingMemory;
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(this->pendingImages.size());
+        dependencyInfo.pImageMemoryBarriers = this->pendingImages.data();
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+        this->pendingMemory = { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+        this->pendingImages.clear();
+        for (auto& tracked : this->images) tracked.pending = -1;
+    }
+
+    // For images that are destroyed (e.g. the views of a retired swap chain), must not have a pending transition
+    void forget(VkImage image) {
+        for (size_t i = 0; i < this->images.size(); ++i)
+            if (this->images[i].image == image && this->images[i].pending < 0) {
+                this->images[i] = this->images.back();
+                this->images.pop_back();
+                return;
+            }
+    }
+};
@@ -0,0 +1,207 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+/*
+    Bindless descriptors (descriptor indexing, core in 1.2)
+    Instead of a descriptor set per material or per pass, every resource the shaders can touch lives in one global set
+    made of three large arrays: sampled images, storage buffers and samplers. A resource is registered once and gets a
+    32-bit handle, its index in the array, which shaders receive through push constants (or inside other buffers) and
+    use to index the array. The set is bound once per command buffer, no matter how many draws or materials follow.
+
+    The arrays are PARTIALLY_BOUND (unused slots may stay empty) and UPDATE_AFTER_BIND with UPDATE_UNUSED_WHILE_PENDING:
+    registering a resource writes its slot while command buffers using other slots are recorded or executing.
+    A released handle must not be in use by the GPU anymore, its slot is handed out again by the next add*().
+
+        uint32_t handle = bindless.addBuffer(buffer, offset, size);
+        bindless.bind(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout);   // Set 0 of every pipeline layout
+        vkCmdPushConstants(cmd, ..., &handle);                                   // storageBuffers[handle] in GLSL
+*/
+class BindlessDescriptors {
+public:
+    enum Binding : uint32_t { SampledImages = 0, StorageBuffers = 1, Samplers = 2, BindingCount };
+    static constexpr uint32_t INVALID_HANDLE = UINT32_MAX;
+
+private:
+    struct Slots {
+        uint32_t capacity = 0, next = 0;
+        std::vector<uint32_t> released;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    Slots slots[BindingCount];
+
+    uint32_t allocateSlot(Binding binding) {
+        Slots& s = this->slots[binding];
+        if (!s.released.empty()) {
+            uint32_t handle = s.released.back();
+            s.released.pop_back();
+            return handle;
+        }
+        if (s.next == s.capacity) {
+            std::cerr << "Bindless descriptor array " << binding << " is full (" << s.capacity << ")\n";
+            return INVALID_HANDLE;
+        }
+        return s.next++;
+    }
+
+    void write(Binding binding, uint32_t handle, VkDescriptorType type, const VkDescriptorImageInfo* imageInfo, const VkDescriptorBufferInfo* bufferInfo) {
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = this->set;
+        descriptorWrite.dstBinding = binding;
+        descriptorWrite.dstArrayElement = handle;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.descriptorType = type;
+        descriptorWrite.pImageInfo = imageInfo;
+        descriptorWrite.pBufferInfo = bufferInfo;
+        vkUpdateDescriptorSets(this->device, 1, &descriptorWrite, 0, nullptr);
+    }
+
+public:
+    // The device must have been created with the descriptor indexing features listed in requiredFeatures()
+    bool create(VkDevice device, VkPhysicalDevice physicalDevice,
+        uint32_t maxSampledImages = 16384, uint32_t maxStorageBuffers = 16384, uint32_t maxSamplers = 256) {
+        this->device = device;
+
+        // The update after bind limits are separate (and on some hardware lower) than the regular ones
+        VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+        vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &vulkan12Properties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        this->slots[SampledImages].capacity = std::min({ maxSampledImages,
+            vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages });
+        this->slots[StorageBuffers].capacity = std::min({ maxStorageBuffers,
+            vulkan12Properties.maxDescriptorSetUpdateAfterBindStorageBuffers, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+        this->slots[Samplers].capacity = std::min({ maxSamplers,
+            vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers });
+
+        // Every array is visible to every stage, so all of them together must also fit the per stage total
+        uint32_t resourceBudget = (vulkan12Properties.maxPerStageUpdateAfterBindResources - this->slots[Samplers].capacity) / 2;
+        this->slots[SampledImages].capacity = std::min(this->slots[SampledImages].capacity, resourceBudget);
+        this->slots[StorageBuffers].capacity = std::min(this->slots[StorageBuffers].capacity, resourceBudget);
+
+        const VkDescriptorType types[BindingCount] = { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_SAMPLER };
+        VkDescriptorSetLayoutBinding bindings[BindingCount]{};
+        VkDescriptorBindingFlags bindingFlags[BindingCount];
+        VkDescriptorPoolSize poolSizes[BindingCount];
+        for (uint32_t binding = 0; binding < BindingCount; ++binding) {
+            bindings[binding].binding = binding;
+            bindings[binding].descriptorType = types[binding];
+            bindings[binding].descriptorCount = this->slots[binding].capacity;
+            bindings[binding].stageFlags = VK_SHADER_STAGE_ALL;
+            bindingFlags[binding] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+            poolSizes[binding] = { types[binding], this->slots[binding].capacity };
+        }
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = BindingCount;
+        bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        layoutInfo.bindingCount = BindingCount;
+        layoutInfo.pBindings = bindings;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &this->setLayout) != VK_SUCCESS) {
+            std::cerr << "Failed to create the bindless VkDescriptorSetLayout\n";
+            return false;
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = BindingCount;
+        poolInfo.pPoolSizes = poolSizes;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &this->pool) != VK_SUCCESS) {
+            std::cerr << "Failed to create the bindless VkDescriptorPool\n";
+            return false;
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = this->pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &this->setLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &this->set) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate the bindless VkDescriptorSet\n";
+            return false;
+        }
+
+        std::cout << " Bindless: " << this->slots[SampledImages].capacity << " images, " << this->slots[StorageBuffers].capacity
+            << " storage buffers, " << this->slots[Samplers].capacity << " samplers\n";
+        return true;
+    }
+
+    void destroy() {
+        if (this->pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(this->device, this->pool, nullptr); // Frees the set
+        if (this->setLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(this->device, this->setLayout, nullptr);
+        this->pool = VK_NULL_HANDLE;
+        this->setLayout = VK_NULL_HANDLE;
+    }
+
+    // Chain into VkPhysicalDeviceVulkan12Features when creating the device, returns false if the device lacks one
+    static bool requiredFeatures(const VkPhysicalDeviceVulkan12Features& supported, VkPhysicalDeviceVulkan12Features& enabled) {
+        enabled.runtimeDescriptorArray = VK_TRUE;
+        enabled.descriptorBindingPartiallyBound = VK_TRUE;
+        enabled.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        enabled.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE; // Also covers samplers
+        enabled.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        enabled.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        enabled.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+
+        return supported.runtimeDescriptorArray && supported.descriptorBindingPartiallyBound &&
+            supported.descriptorBindingUpdateUnusedWhilePending && supported.descriptorBindingSampledImageUpdateAfterBind &&
+            supported.descriptorBindingStorageBufferUpdateAfterBind && supported.shaderSampledImageArrayNonUniformIndexing &&
+            supported.shaderStorageBufferArrayNonUniformIndexing;
+    }
+
+    VkDescriptorSetLayout layout() const { return this->setLayout; }
+
+    // Once per command buffer (secondary buffers inherit no bindings), before any draw or dispatch
+    void bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout) const {
+        vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, 0, 1, &this->set, 0, nullptr);
+    }
+
+    uint32_t addImage(VkImageView imageView, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        uint32_t handle = allocateSlot(SampledImages);
+        if (handle == INVALID_HANDLE) return handle;
+        VkDescriptorImageInfo imageInfo{ VK_NULL_HANDLE, imageView, layout };
+        write(SampledImages, handle, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &imageInfo, nullptr);
+        return handle;
+    }
+
+    uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+        uint32_t handle = allocateSlot(StorageBuffers);
+        if (handle == INVALID_HANDLE) return handle;
+        VkDescriptorBufferInfo bufferInfo{ buffer, offset, range };
+        write(StorageBuffers, handle, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &bufferInfo);
+        return handle;
+    }
+
+    uint32_t addSampler(VkSampler sampler) {
+        uint32_t handle = allocateSlot(Samplers);
+        if (handle == INVALID_HANDLE) return handle;
+        VkDescriptorImageInfo imageInfo{ sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED };
+        write(Samplers, handle, VK_DESCRIPTOR_TYPE_SAMPLER, &imageInfo, nullptr);
+        return handle;
+    }
+
+    // The slot keeps its stale descriptor until reused, PARTIALLY_BOUND only forbids accessing it
+    void release(Binding binding, uint32_t handle) {
+        if (handle != INVALID_HANDLE) this->slots[binding].released.push_back(handle);
+    }
+};
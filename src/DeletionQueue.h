@@ -0,0 +1,115 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+#include "GpuAllocator.h"
+#include "TimelineSemaphore.h"
+
+/*
+    Deferred destruction
+    An object can't be destroyed while a submitted command buffer still references it, and waiting for the device to idle
+    to find out is a hitch every time a resource is replaced (resize, streaming, shader hot reload).
+    Instead the object is retired: tagged with the timeline value of the last submission that may use it, and destroyed by
+    collect() on a later frame, once the timeline has reached that value. Objects are destroyed in the order they were
+    retired, so a view retired before its image also goes first.
+
+    The tag defaults to the last value handed out by the timeline, i.e. every submission made so far. That is exact for
+    an object that is dropped now and never referenced again. The graphics timeline covers the other queues too:
+    each frame's graphics submission waits for its uploads and its async compute work, so it completes last.
+    Presentation is the exception, a present is queued after the submission it waits on and the timeline can't tell
+    when it is done. What a present uses (swap chain, its wait semaphores) is retired with the fences those presents
+    signal (VK_EXT_swapchain_maintenance1), and destroyed once they are signaled as well.
+
+        deletionQueue.retire(oldPipeline);            // Anywhere while recording or between frames
+        deletionQueue.collect();                      // Once per frame, cheap when nothing is due
+        deletionQueue.flush();                        // After vkDeviceWaitIdle, before the device goes
+*/
+class DeletionQueue {
+    struct Entry {
+        uint64_t value;
+        std::vector<VkFence> fences; // Owned by the entry, destroyed after it
+        std::function<void()> destroy;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    GpuAllocator* allocator = nullptr;
+    TimelineSemaphore* timeline = nullptr;
+    std::vector<Entry> entries; // In retirement order
+    uint64_t destroyedCount = 0;
+
+    bool signaled(const Entry& entry) const {
+        for (VkFence fence : entry.fences)
+            if (vkGetFenceStatus(this->device, fence) != VK_SUCCESS) return false;
+        return true;
+    }
+
+    void destroy(Entry& entry) {
+        entry.destroy();
+        for (VkFence fence : entry.fences) vkDestroyFence(this->device, fence, nullptr);
+        ++this->destroyedCount;
+    }
+
+public:
+    void create(VkDevice device, GpuAllocator& allocator, TimelineSemaphore& timeline) {
+        this->device = device;
+        this->allocator = &allocator;
+        this->timeline = &timeline;
+    }
+
+    // Runs destroy once the timeline reaches value, for objects (or groups of them) without an overload below
+    void retire(uint64_t value, std::function<void()> destroy) {
+        this->entries.push_back({ value, {}, std::move(destroy) });
+    }
+
+    void retire(std::function<void()> destroy) { retire(this->timeline->lastSubmittedValue(), std::move(destroy)); }
+
+    // Also waits for every fence to be signaled, for what the timeline doesn't cover (presents). The queue takes the fences over
+    void retire(std::vector<VkFence> fences, std::function<void()> destroy) {
+        this->entries.push_back({ this->timeline->lastSubmittedValue(), std::move(fences), std::move(destroy) });
+    }
+
+    // One overload per handle type, which needs typed non-dispatchable handles (64-bit builds)
+    void retire(VkBuffer buffer, GpuAllocator::Allocation memory) {
+        retire([this, buffer, memory]() mutable { this->allocator->destroyBuffer(buffer, memory); });
+    }
+    void retire(VkImage image, GpuAllocator::Allocation memory) {
+        retire([this, image, memory]() mutable { this->allocator->destroyImage(image, memory); });
+    }
+    void retire(VkImageView imageView) { retire([this, imageView] { vkDestroyImageView(this->device, imageView, nullptr); }); }
+    void retire(VkSampler sampler) { retire([this, sampler] { vkDestroySampler(this->device, sampler, nullptr); }); }
+    void retire(VkPipeline pipeline) { retire([this, pipeline] { vkDestroyPipeline(this->device, pipeline, nullptr); }); }
+    void retire(VkPipelineLayout layout) { retire([this, layout] { vkDestroyPipelineLayout(this->device, layout, nullptr); }); }
+    void retire(VkSemaphore semaphore) { retire([this, semaphore] { vkDestroySemaphore(this->device, semaphore, nullptr); }); }
+
+    // Destroys everything the GPU is done with, call once per frame
+    void collect() {
+        if (this->entries.empty()) return;
+
+        // The timeline only moves forward, so one query decides for every entry
+        uint64_t completed = this->timeline->completedValue();
+        size_t kept = 0;
+        for (size_t i = 0; i < this->entries.size(); ++i) {
+            if (this->entries[i].value <= completed && signaled(this->entries[i])) destroy(this->entries[i]);
+            else {
+                if (kept != i) this->entries[kept] = std::move(this->entries[i]);
+                ++kept;
+            }
+        }
+        this->entries.resize(kept);
+    }
+
+    // Destroys everything, the device must be idle. Idle doesn't include presents, so their fences are still waited for
+    void flush() {
+        for (Entry& entry : this->entries) {
+            if (!entry.fences.empty()) vkWaitForFences(this->device, static_cast<uint32_t>(entry.fences.size()), entry.fences.data(), VK_TRUE, UINT64_MAX);
+            destroy(entry);
+        }
+        this->entries.clear();
+    }
+
+    size_t pending() const { return this->entries.size(); }
+    uint64_t destroyed() const { return this->destroyedCount; }
+};
@@ -0,0 +1,221 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+#include "BindlessDescriptors.h"
+
+/*
+    Physical device selection
+    Every device is probed for what the renderer can't run without (Vulkan 1.3, the device extensions, dynamic rendering,
+    synchronization2, timeline semaphores, the bindless descriptor indexing features, a graphics queue and, with a window,
+    a queue that can present to it). Devices missing any of it are never picked, the rest are ranked by a score:
+
+        device type         discrete 10000, integrated 5000, virtual 2000, CPU 100
+        VRAM                100 per GiB of the largest DEVICE_LOCAL heap
+        queue topology      500 for a compute family without graphics (async compute), 250 for a transfer only family (DMA),
+                            100 when graphics and present share a family
+        limits              maxImageDimension2D / 256 and maxComputeSharedMemorySize / 1024, tie breakers
+
+    The ranking can be overridden with --device or VULKANAPP_DEVICE, matching the enumeration index, the device UUID
+    (VkPhysicalDeviceIDProperties::deviceUUID, or a prefix of it, at least 8 hex digits) or a case insensitive part of
+    the device name, in that order. The device UUID tells identical GPUs apart and survives driver updates, unlike
+    pipelineCacheUUID. A number that is no valid index is matched as a UUID prefix or name part (--device 4090).
+    An override that matches nothing, or only unusable devices, is an error rather than a silent fallback.
+*/
+struct DeviceCandidate {
+    VkPhysicalDevice device = VK_NULL_HANDLE;
+    uint32_t index = 0; // In vkEnumeratePhysicalDevices order
+    VkPhysicalDeviceProperties properties{};
+    std::string uuid; // deviceUUID as hex, empty below Vulkan 1.1
+    VkDeviceSize deviceLocalBytes = 0; // Largest DEVICE_LOCAL heap
+    bool dedicatedCompute = false, dedicatedTransfer = false, sharedPresent = false;
+    std::vector<std::string> missing; // Why the device can't run the renderer, empty when usable
+    int64_t score = 0;
+
+    bool usable() const { return this->missing.empty(); }
+};
+
+class DeviceSelector {
+    static std::string lower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    static DeviceCandidate probe(VkPhysicalDevice device, uint32_t index, VkSurfaceKHR surface, const std::vector<const char*>& extensions) {
+        DeviceCandidate candidate;
+        candidate.device = device;
+        candidate.index = index;
+        vkGetPhysicalDeviceProperties(device, &candidate.properties);
+        const VkPhysicalDeviceProperties& properties = candidate.properties;
+
+        if (properties.apiVersion >= VK_API_VERSION_1_1) {
+            VkPhysicalDeviceIDProperties idProperties{};
+            idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+            VkPhysicalDeviceProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &idProperties;
+            vkGetPhysicalDeviceProperties2(device, &properties2);
+
+            std::ostringstream uuid;
+            for (uint8_t byte : idProperties.deviceUUID) uuid << std::hex << std::setw(2) << std::setfill('0') << uint32_t(byte);
+            candidate.uuid = uuid.str();
+        }
+
+        if (properties.apiVersion < VK_API_VERSION_1_3) candidate.missing.push_back("Vulkan 1.3");
+
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+        std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
+        for (const auto& extension : availableExtensions) requiredExtensions.erase(extension.extensionName);
+        for (const auto& extension : requiredExtensions) candidate.missing.push_back(extension);
+
+        // Chaining feature structs of a newer version than the device's is invalid, such a device is unusable anyway
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceVulkan13Features vulkan13Features{};
+        vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        vulkan13Features.pNext = &vulkan12Features;
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &vulkan13Features;
+        if (properties.apiVersion >= VK_API_VERSION_1_3) vkGetPhysicalDeviceFeatures2(device, &features);
+
+        if (!vulkan13Features.dynamicRendering) candidate.missing.push_back("dynamicRendering");
+        if (!vulkan13Features.synchronization2) candidate.missing.push_back("synchronization2");
+        if (!vulkan12Features.timelineSemaphore) candidate.missing.push_back("timelineSemaphore");
+        VkPhysicalDeviceVulkan12Features bindlessFeatures{};
+        if (!BindlessDescriptors::requiredFeatures(vulkan12Features, bindlessFeatures)) candidate.missing.push_back("descriptor indexing");
+
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+            if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                candidate.deviceLocalBytes = std::max(candidate.deviceLocalBytes, memoryProperties.memoryHeaps[i].size);
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+        bool graphics = false, present = surface == VK_NULL_HANDLE;
+        for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+            VkQueueFlags flags = queueFamilies[i].queueFlags;
+            VkBool32 presentSupport = VK_FALSE;
+            if (surface != VK_NULL_HANDLE) vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+
+            graphics |= (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
+            present |= presentSupport == VK_TRUE;
+            candidate.sharedPresent |= (flags & VK_QUEUE_GRAPHICS_BIT) && presentSupport;
+            candidate.dedicatedCompute |= (flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT);
+            candidate.dedicatedTransfer |= (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+        }
+        if (!graphics) candidate.missing.push_back("graphics queue");
+        if (!present) candidate.missing.push_back("present queue");
+
+        candidate.score = score(candidate);
+        return candidate;
+    }
+
+public:
+    static int64_t score(const DeviceCandidate& candidate) {
+        int64_t score = 0;
+        switch (candidate.properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 10000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 5000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 2000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 100; break;
+        default: break;
+        }
+        score += static_cast<int64_t>(candidate.deviceLocalBytes >> 30) * 100;
+        if (candidate.dedicatedCompute) score += 500;
+        if (candidate.dedicatedTransfer) score += 250;
+        if (candidate.sharedPresent) score += 100;
+        score += candidate.properties.limits.maxImageDimension2D / 256;
+        score += candidate.properties.limits.maxComputeSharedMemorySize / 1024;
+        return score;
+    }
+
+    // surface: VK_NULL_HANDLE when nothing is presented, which skips the present queue requirement
+    static std::vector<DeviceCandidate> probe(VkInstance instance, VkSurfaceKHR surface, const std::vector<const char*>& extensions) {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        std::vector<DeviceCandidate> candidates;
+        for (uint32_t i = 0; i < deviceCount; ++i) candidates.push_back(probe(devices[i], i, surface, extensions));
+        return candidates;
+    }
+
+    // byIndex: the selector is the enumeration index of one of the devices, see select()
+    static bool matches(const DeviceCandidate& candidate, const std::string& selector, bool byIndex) {
+        if (byIndex) return candidate.index == strtoul(selector.c_str(), nullptr, 10);
+
+        std::string hex;
+        for (char c : lower(selector)) if (c != '-') hex += c;
+        if (hex.size() >= 8 && std::all_of(hex.begin(), hex.end(), [](unsigned char c) { return std::isxdigit(c); }) &&
+            candidate.uuid.compare(0, hex.size(), hex) == 0) return true;
+
+        return lower(candidate.properties.deviceName).find(lower(selector)) != std::string::npos;
+    }
+
+    // Best usable device, or the best usable one matching the override. nullptr, with the reason printed, if there is none
+    static const DeviceCandidate* select(const std::vector<DeviceCandidate>& candidates, const std::string& override) {
+        // Any other number is a UUID prefix or part of a name ("4090")
+        bool byIndex = !override.empty() && override.size() < 10 &&
+            std::all_of(override.begin(), override.end(), [](unsigned char c) { return std::isdigit(c); }) &&
+            strtoul(override.c_str(), nullptr, 10) < candidates.size();
+
+        const DeviceCandidate* best = nullptr;
+        bool matched = false;
+        for (const DeviceCandidate& candidate : candidates) {
+            if (!override.empty() && !matches(candidate, override, byIndex)) continue;
+            matched = true;
+            if (candidate.usable() && (!best || candidate.score > best->score)) best = &candidate;
+        }
+
+        if (best) return best;
+        if (candidates.empty()) std::cerr << "Failed to find GPUs with Vulkan support\n";
+        else if (!matched) std::cerr << "No device matches \"" << override << "\", see --list-devices\n";
+        else std::cerr << "No " << (override.empty() ? "" : "matching ") << "device supports what the renderer needs, see --list-devices\n";
+        return nullptr;
+    }
+
+    static void printReport(const std::vector<DeviceCandidate>& candidates, const DeviceCandidate* selected) {
+        std::cout << "\n Available Devices:\n";
+        for (const DeviceCandidate& candidate : candidates) {
+            const char* type = "Other";
+            switch (candidate.properties.deviceType) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: type = "Discrete"; break;
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: type = "Integrated"; break;
+            case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: type = "Virtual"; break;
+            case VK_PHYSICAL_DEVICE_TYPE_CPU: type = "CPU"; break;
+            default: break;
+            }
+
+            uint32_t apiVersion = candidate.properties.apiVersion;
+            std::cout << (&candidate == selected ? "\n * " : "\n   ") << candidate.index << ": " << candidate.properties.deviceName
+                << " (" << type << ") (" << VK_VERSION_MAJOR(apiVersion) << "." << VK_VERSION_MINOR(apiVersion) << "." << VK_VERSION_PATCH(apiVersion) << ")\n"
+                << "     UUID " << candidate.uuid << ", " << (candidate.deviceLocalBytes >> 20) << " MiB device local"
+                << (candidate.dedicatedCompute ? ", async compute" : "") << (candidate.dedicatedTransfer ? ", DMA queue" : "") << "\n";
+
+            if (candidate.usable()) std::cout << "     Score " << candidate.score << "\n";
+            else {
+                std::cout << "     Unusable, missing:";
+                for (const std::string& requirement : candidate.missing) std::cout << " " << requirement;
+                std::cout << "\n";
+            }
+        }
+        std::cout << std::endl;
+    }
+};
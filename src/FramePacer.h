@@ -0,0 +1,99 @@
+#pragma once
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include "FrameStats.h"
+
+/*
+    Frame pacing
+    Caps the frame rate on the CPU, independent of the present mode, and measures the frame time actually achieved.
+    Every frame starts on a deadline one period after the previous one. Sleeping alone wakes up late by up to the
+    OS timer granularity (~1 ms on Linux, up to 15.6 ms on Windows), spinning alone burns a core, so the pacer sleeps
+    until shortly before the deadline and spins (yielding) the rest of the way. The sleep margin adapts to the
+    oversleeping actually observed, so a coarse timer just means a longer spin instead of a missed deadline.
+
+    A frame that comes in more than a period late resets the schedule instead of being followed by a burst of
+    short frames to catch up, which would look worse than the late frame itself.
+
+    Frame time is measured between consecutive frame starts whether or not a target is set, jitter is its
+    standard deviation: a steady 16.7 ms beats 8 ms frames alternating with 25 ms ones, although both average 60 fps.
+*/
+class FramePacer {
+    using Clock = std::chrono::steady_clock;
+
+    struct Interval {
+        LatencyHistogram frameTimes;
+        double mean = 0.0, m2 = 0.0; // Welford's running variance, in ns
+        uint64_t count = 0;
+
+        void record(uint64_t ns) {
+            this->frameTimes.record(ns);
+            double delta = ns - this->mean;
+            this->mean += delta / ++this->count;
+            this->m2 += delta * (ns - this->mean);
+        }
+        double jitter() const { return this->count > 1 ? std::sqrt(this->m2 / (this->count - 1)) : 0.0; }
+    };
+
+    Clock::duration period{}; // Zero when uncapped
+    Clock::duration sleepMargin = std::chrono::microseconds(500);
+    Clock::time_point deadline{}, lastFrameStart{};
+    Interval interval, total;
+
+    static void print(const char* title, const Interval& stats) {
+        if (!stats.count) return;
+        std::cout << " Frame time (" << title << "): " << std::fixed << std::setprecision(3)
+            << stats.mean / 1e6 << " ms mean (" << std::setprecision(1) << 1e9 / stats.mean << " fps), "
+            << std::setprecision(3) << stats.frameTimes.percentile(0.50) / 1e6 << " p50, "
+            << stats.frameTimes.percentile(0.99) / 1e6 << " p99, " << stats.frameTimes.max() / 1e6 << " max, "
+            << stats.jitter() / 1e6 << " ms jitter\n" << std::defaultfloat;
+    }
+
+public:
+    // 0 or less disables the limiter, the frame time is still measured
+    void setTargetRate(double framesPerSecond) {
+        this->period = framesPerSecond > 0.0
+            ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond))
+            : Clock::duration::zero();
+    }
+    bool limited() const { return this->period > Clock::duration::zero(); }
+
+    // Call once at the start of every frame, returns when the frame may start
+    void wait() {
+        Clock::time_point now = Clock::now();
+
+        if (this->limited()) {
+            if (this->deadline == Clock::time_point{} || now > this->deadline + this->period)
+                this->deadline = now; // First frame, or too late to keep the schedule
+
+            Clock::time_point wakeUp = this->deadline - this->sleepMargin;
+            if (now < wakeUp) {
+                std::this_thread::sleep_until(wakeUp);
+                Clock::duration overshoot = Clock::now() - wakeUp;
+                // Grows at once to the worst oversleep seen, shrinks slowly back when the timer behaves
+                this->sleepMargin = std::max(overshoot + std::chrono::microseconds(100), this->sleepMargin - this->sleepMargin / 16);
+            }
+            while ((now = Clock::now()) < this->deadline) std::this_thread::yield();
+            this->deadline += this->period;
+        }
+
+        if (this->lastFrameStart != Clock::time_point{}) {
+            uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - this->lastFrameStart).count());
+            this->interval.record(ns);
+            this->total.record(ns);
+        }
+        this->lastFrameStart = now;
+    }
+
+    void printInterval() {
+        print("interval", this->interval);
+        this->interval = Interval{};
+    }
+
+    void printTotal() const { print("whole run", this->total); }
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+
+#include "GpuAllocator.h"
+
+/*
+    Per frame data rewritten by the CPU every frame
+    One persistently mapped buffer split into a slice per frame in flight. A frame writes its own slice while the GPU
+    still reads the slices of older frames, and the slice is free again once the frame slot's timeline value was waited,
+    so there is no copy, no staging and no extra synchronization. Shaders see one slice at a time through a dynamic
+    descriptor offset (or an offset when binding), the descriptor itself is written once.
+
+    Slices are aligned to the offset alignment the descriptor type requires and to nonCoherentAtomSize,
+    so a slice can be flushed on its own when the memory is not HOST_COHERENT.
+
+    When several queue families read the ring it is created CONCURRENT: it is rewritten every frame,
+    an ownership transfer per frame would cost more than concurrent access does for a buffer.
+*/
+class FrameRingBuffer {
+    VkDevice device = VK_NULL_HANDLE;
+    GpuAllocator* allocator = nullptr;
+    VkBuffer ringBuffer = VK_NULL_HANDLE;
+    GpuAllocator::Allocation memory;
+    VkDeviceSize stride = 0, size = 0;
+    bool coherent = true;
+
+public:
+    // alignment: e.g. minStorageBufferOffsetAlignment for a STORAGE_BUFFER_DYNAMIC descriptor
+    // queueFamilies: every family that reads the ring, if more than one
+    bool create(VkDevice device, VkPhysicalDevice physicalDevice, GpuAllocator& allocator, VkDeviceSize sliceSize,
+        uint32_t frameCount, VkBufferUsageFlags usage, VkDeviceSize alignment, const std::vector<uint32_t>& queueFamilies = {}) {
+        this->device = device;
+        this->allocator = &allocator;
+        this->size = sliceSize;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        VkDeviceSize atom = std::max<VkDeviceSize>({ alignment, properties.limits.nonCoherentAtomSize, 1 }); // Both are powers of two
+        this->stride = (sliceSize + atom - 1) & ~(atom - 1);
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = this->stride * frameCount;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = queueFamilies.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+
+        // Written once and read once per frame, plain host memory the GPU reads over the bus is the right place
+        if (!allocator.createBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            this->ringBuffer, this->memory)) {
+            std::cerr << "Failed to create a frame ring buffer of " << (bufferInfo.size >> 20) << " MiB\n";
+            return false;
+        }
+        this->coherent = allocator.isCoherent(this->memory);
+        return true;
+    }
+
+    void destroy() {
+        if (this->allocator) this->allocator->destroyBuffer(this->ringBuffer, this->memory);
+        this->ringBuffer = VK_NULL_HANDLE;
+    }
+
+    VkBuffer buffer() const { return this->ringBuffer; }
+    VkDeviceSize sliceSize() const { return this->size; }
+    VkDeviceSize offset(uint32_t frame) const { return this->stride * frame; }
+    void* data(uint32_t frame) const { return static_cast<uint8_t*>(this->memory.mapped) + offset(frame); }
+
+    // Makes the CPU writes to a slice visible to the device, call before submitting the frame that reads it
+    void flush(uint32_t frame) {
+        if (this->coherent) return;
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = this->memory.memory;
+        range.offset = this->memory.offset + offset(frame);
+        range.size = this->stride;
+        vkFlushMappedMemoryRanges(this->device, 1, &range);
+    }
+};
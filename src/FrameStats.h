@@ -0,0 +1,134 @@
+#pragma once
+#include <iostream>
+#include <iomanip>
+#include <array>
+#include <chrono>
+#include <bit>
+#include <cstdint>
+#include <algorithm>
+
+/*
+    CPU frame phase latency histograms
+    Averages hide spikes, so every phase of mainLoop() is timed with a steady clock and recorded into a histogram
+    from which p50/p95/p99/max can be read.
+
+    The histogram is log-linear (like HdrHistogram): every power of two is split into 8 linear sub-buckets,
+    which keeps the relative error of any percentile under 12.5% from 1 us to over a minute
+    with a fixed array of counters. Recording is a couple of bit operations and one increment, no allocation ever.
+*/
+class LatencyHistogram {
+    static constexpr uint32_t SUB_BUCKET_BITS = 3;
+    static constexpr uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr uint32_t MIN_EXPONENT = 10; // Below 2^10 ns (~1 us) buckets are linear
+    static constexpr uint32_t MAX_EXPONENT = 36; // ~68 s, anything above lands in the last bucket
+    static constexpr uint32_t BUCKET_COUNT = (MAX_EXPONENT - MIN_EXPONENT + 2) * SUB_BUCKETS;
+
+    std::array<uint32_t, BUCKET_COUNT> counts{};
+    uint64_t sampleCount = 0, totalNs = 0, maxNs = 0;
+
+    static uint32_t bucketOf(uint64_t ns) {
+        if (ns < (1ull << MIN_EXPONENT)) return static_cast<uint32_t>(ns >> (MIN_EXPONENT - SUB_BUCKET_BITS));
+
+        uint32_t exponent = 63 - std::countl_zero(ns);
+        uint32_t subBucket = static_cast<uint32_t>(ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+        return std::min((exponent - MIN_EXPONENT + 1) * SUB_BUCKETS + subBucket, BUCKET_COUNT - 1);
+    }
+
+    static uint64_t bucketUpperBound(uint32_t bucket) {
+        if (bucket < SUB_BUCKETS) return static_cast<uint64_t>(bucket + 1) << (MIN_EXPONENT - SUB_BUCKET_BITS);
+
+        uint32_t exponent = bucket / SUB_BUCKETS - 1 + MIN_EXPONENT;
+        uint32_t subBucket = bucket % SUB_BUCKETS;
+        return static_cast<uint64_t>(SUB_BUCKETS + subBucket + 1) << (exponent - SUB_BUCKET_BITS);
+    }
+
+public:
+    void record(uint64_t ns) {
+        ++this->counts[bucketOf(ns)];
+        ++this->sampleCount;
+        this->totalNs += ns;
+        this->maxNs = std::max(this->maxNs, ns);
+    }
+
+    void reset() { *this = LatencyHistogram{}; }
+
+    uint64_t count() const { return this->sampleCount; }
+    uint64_t max() const { return this->maxNs; }
+    double mean() const { return this->sampleCount ? static_cast<double>(this->totalNs) / this->sampleCount : 0.0; }
+
+    // Upper bound of the bucket holding the requested percentile (0..1), never above the exact max
+    uint64_t percentile(double fraction) const {
+        if (!this->sampleCount) return 0;
+
+        uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * this->sampleCount + 0.5));
+        uint64_t seen = 0;
+        for (uint32_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+            seen += this->counts[bucket];
+            if (seen >= target) return std::min(bucketUpperBound(bucket), this->maxNs);
+        }
+        return this->maxNs;
+    }
+};
+
+enum class FramePhase : uint32_t {
+    FrameLimiter,
+    WaitForFrame,
+    AcquireImage,
+    UpdateInstances,
+    RecordCommands,
+    QueueSubmit,
+    QueuePresent,
+    PollEvents,
+    Count
+};
+
+class FrameStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    static constexpr uint32_t PHASE_COUNT = static_cast<uint32_t>(FramePhase::Count);
+    static constexpr const char* PHASE_NAMES[PHASE_COUNT] = {
+        "frame limiter", "wait for frame slot", "vkAcquireNextImageKHR", "update instances", "record commands", "vkQueueSubmit", "vkQueuePresentKHR", "glfwPollEvents"
+    };
+
+    std::array<LatencyHistogram, PHASE_COUNT> interval; // Since the last periodic dump
+    std::array<LatencyHistogram, PHASE_COUNT> total; // Whole run
+
+    static void print(const char* title, const std::array<LatencyHistogram, PHASE_COUNT>& histograms) {
+        std::cout << "\n CPU frame phases (" << title << ", ms)     p50       p95       p99       max      mean   samples\n";
+        for (uint32_t phase = 0; phase < PHASE_COUNT; ++phase) {
+            const LatencyHistogram& histogram = histograms[phase];
+            if (!histogram.count()) continue;
+
+            std::cout << "  " << std::left << std::setw(30) << PHASE_NAMES[phase] << std::right << std::fixed << std::setprecision(3)
+                << std::setw(10) << histogram.percentile(0.50) / 1e6
+                << std::setw(10) << histogram.percentile(0.95) / 1e6
+                << std::setw(10) << histogram.percentile(0.99) / 1e6
+                << std::setw(10) << histogram.max() / 1e6
+                << std::setw(10) << histogram.mean() / 1e6
+                << std::setw(10) << histogram.count() << "\n";
+        }
+        std::cout << std::defaultfloat;
+    }
+
+public:
+    // Records the time elapsed since start for the phase and returns the current time, so phases can be chained:
+    //     auto t = FrameStats::Clock::now(); work(); t = stats.record(FramePhase::X, t); more(); t = stats.record(...);
+    Clock::time_point record(FramePhase phase, Clock::time_point start) {
+        Clock::time_point now = Clock::now();
+        uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+        this->interval[static_cast<uint32_t>(phase)].record(ns);
+        this->total[static_cast<uint32_t>(phase)].record(ns);
+        return now;
+    }
+
+    const LatencyHistogram& histogram(FramePhase phase) const { return this->total[static_cast<uint32_t>(phase)]; }
+
+    void printInterval() {
+        print("interval", this->interval);
+        for (auto& histogram : this->interval) histogram.reset();
+    }
+
+    void printTotal() const { print("whole run", this->total); }
+};
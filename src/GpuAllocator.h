@@ -0,0 +1,333 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <bit>
+#include <algorithm>
+
+/*
+    GPU memory sub-allocator
+    vkAllocateMemory is a kernel round trip and drivers only guarantee maxMemoryAllocationCount (often 4096) live
+    allocations, so resources must not get a VkDeviceMemory each. Instead memory is taken in large blocks per memory type
+    and handed out in pieces with a buddy allocator: sizes are rounded up to a power of two, a free piece is split in halves
+    until it fits, and a freed piece merges back with its buddy (the other half of its parent) whenever that one is free too.
+    A power of two piece is aligned to its own size, so any alignment up to the size comes for free.
+
+    bufferImageGranularity: on some GPUs a linear resource (buffer, linear image) and an optimal tiling image must not share a
+    "page" of that size. When the limit is above 1, linear and optimal resources simply get their own blocks, so they never meet.
+
+    Allocations larger than half a block get a dedicated VkDeviceMemory, they would waste most of a block anyway.
+    HOST_VISIBLE blocks are mapped once for their whole lifetime, Allocation::mapped points at the piece.
+*/
+class GpuAllocator {
+public:
+    enum class ResourceKind { Linear, Optimal };
+    struct Block;
+
+    struct Allocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0, size = 0;
+        void* mapped = nullptr; // Only for HOST_VISIBLE memory
+        uint32_t memoryType = 0;
+
+        // Internal: owning block (nullptr for dedicated allocations) and buddy order
+        Block* block = nullptr;
+        uint32_t order = 0;
+    };
+
+    struct Stats {
+        uint32_t blockCount = 0, dedicatedCount = 0, allocationCount = 0;
+        VkDeviceSize reservedBytes = 0; // Device memory taken from the driver
+        VkDeviceSize allocatedBytes = 0; // Handed out, including the rounding up to a power of two
+        VkDeviceSize requestedBytes = 0; // What the resources asked for
+    };
+
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint8_t* mapped = nullptr;
+        uint32_t memoryType = 0;
+        ResourceKind kind = ResourceKind::Linear;
+        std::vector<std::set<VkDeviceSize>> freeOffsets; // [order], offsets of free pieces of MIN_SIZE << order bytes
+        uint32_t allocationCount = 0;
+    };
+
+private:
+    static constexpr VkDeviceSize MIN_SIZE = 256; // Smallest piece, nothing smaller is worth tracking
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE;
+    uint32_t maxOrder = 0; // blockSize == MIN_SIZE << maxOrder
+    bool separateKinds = false; // bufferImageGranularity > 1
+
+    std::vector<std::unique_ptr<Block>> blocks;
+    Stats statistics;
+    std::mutex mutex;
+
+    static uint32_t orderFor(VkDeviceSize size) {
+        VkDeviceSize pieces = (std::max(size, MIN_SIZE) + MIN_SIZE - 1) / MIN_SIZE;
+        return static_cast<uint32_t>(std::bit_width(pieces - 1)); // ceil(log2(pieces))
+    }
+
+    // Picks a type allowed by typeBits with every required flag, preferring one that also has the preferred flags.
+    // Software implementations may flag nothing as DEVICE_LOCAL, so with no required flags any allowed type will do
+    bool findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, uint32_t& memoryType) const {
+        for (VkMemoryPropertyFlags wanted : { required | preferred, required })
+            for (uint32_t i = 0; i < this->memoryProperties.memoryTypeCount; ++i)
+                if ((typeBits & (1u << i)) && (this->memoryProperties.memoryTypes[i].propertyFlags & wanted) == wanted) {
+                    memoryType = i;
+                    return true;
+                }
+        return false;
+    }
+
+    bool allocateMemory(VkDeviceSize size, uint32_t memoryType, VkDeviceMemory& memory, void** mapped) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        if (vkAllocateMemory(this->device, &allocInfo, nullptr, &memory) != VK_SUCCESS) return false;
+
+        *mapped = nullptr;
+        if ((this->memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+            vkMapMemory(this->device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+            vkFreeMemory(this->device, memory, nullptr);
+            return false;
+        }
+        return true;
+    }
+
+    Block* createBlock(uint32_t memoryType, ResourceKind kind) {
+        auto block = std::make_unique<Block>();
+        void* mapped;
+        if (!allocateMemory(this->blockSize, memoryType, block->memory, &mapped)) return nullptr;
+
+        block->mapped = static_cast<uint8_t*>(mapped);
+        block->memoryType = memoryType;
+        block->kind = kind;
+        block->freeOffsets.resize(this->maxOrder + 1);
+        block->freeOffsets[this->maxOrder].insert(0);
+
+        ++this->statistics.blockCount;
+        this->statistics.reservedBytes += this->blockSize;
+        this->blocks.push_back(std::move(block));
+        return this->blocks.back().get();
+    }
+
+    // Takes a free piece of the given order from the block, splitting a larger one if needed
+    bool takePiece(Block& block, uint32_t order, VkDeviceSize& offset) {
+        uint32_t from = order;
+        while (from <= this->maxOrder && block.freeOffsets[from].empty()) ++from;
+        if (from > this->maxOrder) return false;
+
+        offset = *block.freeOffsets[from].begin();
+        block.freeOffsets[from].erase(block.freeOffsets[from].begin());
+
+        // Keep the lower half, the upper half of every split becomes free
+        for (; from > order; --from)
+            block.freeOffsets[from - 1].insert(offset + (MIN_SIZE << (from - 1)));
+        return true;
+    }
+
+    void releasePiece(Block& block, uint32_t order, VkDeviceSize offset) {
+        for (; order < this->maxOrder; ++order) {
+            VkDeviceSize buddy = offset ^ (MIN_SIZE << order);
+            auto found = block.freeOffsets[order].find(buddy);
+            if (found == block.freeOffsets[order].end()) break;
+
+            block.freeOffsets[order].erase(found);
+            offset = std::min(offset, buddy);
+        }
+        block.freeOffsets[order].insert(offset);
+    }
+
+    void destroyBlock(size_t index) {
+        Block& block = *this->blocks[index];
+        if (block.mapped) vkUnmapMemory(this->device, block.memory);
+        vkFreeMemory(this->device, block.memory, nullptr);
+
+        --this->statistics.blockCount;
+        this->statistics.reservedBytes -= this->blockSize;
+        this->blocks[index] = std::move(this->blocks.back());
+        this->blocks.pop_back();
+    }
+
+public:
+    void create(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE) {
+        this->device = device;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &this->memoryProperties);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        this->separateKinds = properties.limits.bufferImageGranularity > 1;
+
+        this->maxOrder = orderFor(blockSize);
+        this->blockSize = MIN_SIZE << this->maxOrder;
+    }
+
+    void destroy() {
+        if (this->statistics.allocationCount)
+            std::cerr << "GpuAllocator: " << this->statistics.allocationCount << " allocation(s) leaked\n";
+        while (!this->blocks.empty()) destroyBlock(this->blocks.size() - 1);
+    }
+
+    bool allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+        ResourceKind kind, Allocation& allocation) {
+        allocation = {};
+        if (!findMemoryType(requirements.memoryTypeBits, required, preferred, allocation.memoryType)) {
+            std::cerr << "GpuAllocator: no memory type fits the resource\n";
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        VkDeviceSize pieceSize = std::max(requirements.size, requirements.alignment);
+
+        if (pieceSize > this->blockSize / 2) {
+            if (!allocateMemory(requirements.size, allocation.memoryType, allocation.memory, &allocation.mapped)) {
+                std::cerr << "GpuAllocator: failed to allocate " << requirements.size << " bytes of dedicated memory\n";
+                return false;
+            }
+            allocation.size = requirements.size;
+
+            ++this->statistics.dedicatedCount;
+            ++this->statistics.allocationCount;
+            this->statistics.reservedBytes += requirements.size;
+            this->statistics.allocatedBytes += requirements.size;
+            this->statistics.requestedBytes += requirements.size;
+            return true;
+        }
+
+        uint32_t order = orderFor(pieceSize);
+        if (!this->separateKinds) kind = ResourceKind::Linear; // Everything may share a block
+
+        Block* block = nullptr;
+        for (auto& candidate : this->blocks)
+            if (candidate->memoryType == allocation.memoryType && candidate->kind == kind &&
+                takePiece(*candidate, order, allocation.offset)) { block = candidate.get(); break; }
+
+        if (!block) {
+            block = createBlock(allocation.memoryType, kind);
+            if (!block || !takePiece(*block, order, allocation.offset)) {
+                std::cerr << "GpuAllocator: failed to allocate a " << this->blockSize << " byte block\n";
+                return false;
+            }
+        }
+
+        ++block->allocationCount;
+        allocation.block = block;
+        allocation.order = order;
+        allocation.memory = block->memory;
+        allocation.size = requirements.size;
+        if (block->mapped) allocation.mapped = block->mapped + allocation.offset;
+
+        ++this->statistics.allocationCount;
+        this->statistics.allocatedBytes += MIN_SIZE << order;
+        this->statistics.requestedBytes += requirements.size;
+        return true;
+    }
+
+    void free(Allocation& allocation) {
+        if (allocation.memory == VK_NULL_HANDLE) return;
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        --this->statistics.allocationCount;
+        this->statistics.requestedBytes -= allocation.size;
+
+        if (!allocation.block) {
+            if (allocation.mapped) vkUnmapMemory(this->device, allocation.memory);
+            vkFreeMemory(this->device, allocation.memory, nullptr);
+            --this->statistics.dedicatedCount;
+            this->statistics.reservedBytes -= allocation.size;
+            this->statistics.allocatedBytes -= allocation.size;
+        }
+        else {
+            Block& block = *allocation.block;
+            releasePiece(block, allocation.order, allocation.offset);
+            this->statistics.allocatedBytes -= MIN_SIZE << allocation.order;
+
+            // Keep one empty block per memory type around, freeing and reallocating it on every resize would defeat the purpose
+            if (--block.allocationCount == 0) {
+                for (size_t i = 0; i < this->blocks.size(); ++i) {
+                    Block& other = *this->blocks[i];
+                    if (&other != &block && other.memoryType == block.memoryType && other.kind == block.kind && other.allocationCount == 0) {
+                        destroyBlock(i);
+                        break;
+                    }
+                }
+            }
+        }
+
+        allocation = {};
+    }
+
+    bool createBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+        VkBuffer& buffer, Allocation& allocation) {
+        if (vkCreateBuffer(this->device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            std::cerr << "Failed to create VkBuffer\n";
+            return false;
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(this->device, buffer, &requirements);
+        if (!allocate(requirements, required, preferred, ResourceKind::Linear, allocation) ||
+            vkBindBufferMemory(this->device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+            vkDestroyBuffer(this->device, buffer, nullptr);
+            free(allocation);
+            buffer = VK_NULL_HANDLE;
+            return false;
+        }
+        return true;
+    }
+
+    bool createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+        VkImage& image, Allocation& allocation) {
+        if (vkCreateImage(this->device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            std::cerr << "Failed to create VkImage\n";
+            return false;
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(this->device, image, &requirements);
+        ResourceKind kind = imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
+        if (!allocate(requirements, required, preferred, kind, allocation) ||
+            vkBindImageMemory(this->device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+            vkDestroyImage(this->device, image, nullptr);
+            free(allocation);
+            image = VK_NULL_HANDLE;
+            return false;
+        }
+        return true;
+    }
+
+    void destroyBuffer(VkBuffer buffer, Allocation& allocation) {
+        if (buffer != VK_NULL_HANDLE) vkDestroyBuffer(this->device, buffer, nullptr);
+        free(allocation);
+    }
+
+    void destroyImage(VkImage image, Allocation& allocation) {
+        if (image != VK_NULL_HANDLE) vkDestroyImage(this->device, image, nullptr);
+        free(allocation);
+    }
+
+    // Non-coherent HOST_VISIBLE memory needs writes flushed before the GPU reads them
+    bool isCoherent(const Allocation& allocation) const {
+        return this->memoryProperties.memoryTypes[allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->statistics;
+    }
+
+    void printStats() {
+        Stats current = stats();
+        std::cout << " GPU memory: " << current.allocationCount << " allocation(s) in " << current.blockCount << " block(s) + "
+            << current.dedicatedCount << " dedicated, " << (current.requestedBytes >> 10) << " KiB requested, "
+            << (current.allocatedBytes >> 10) << " KiB allocated, " << (current.reservedBytes >> 10) << " KiB reserved\n";
+    }
+};
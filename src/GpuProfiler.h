@@ -0,0 +1,188 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+/*
+    GPU profiler
+    The CPU can't see how long the GPU spends on a command buffer, but the GPU can write its own clock into a query pool
+    with vkCmdWriteTimestamp. A pair of timestamps around each pass gives its GPU duration, in ticks of
+    VkPhysicalDeviceLimits::timestampPeriod nanoseconds.
+
+    Every frame in flight owns its own range of queries. The results of a range are read back right before the range is
+    reused, frameCount frames later, when that frame is already known to be complete,
+    so reading them never stalls the CPU (we don't even pass VK_QUERY_RESULT_WAIT_BIT).
+
+    Usage while recording:
+        profiler.beginFrame(cmd, currentFrame);
+        uint32_t scope = profiler.beginScope(cmd, currentFrame, "render");
+        ... vkCmd* ...
+        profiler.endScope(cmd, currentFrame, scope);
+*/
+class GpuProfiler {
+public:
+    static constexpr uint32_t MAX_SCOPES_PER_FRAME = 32;
+
+    struct PassTiming {
+        std::string name;
+        double lastMs = 0.0; // Most recent resolved frame
+        double intervalTotalMs = 0.0, intervalMaxMs = 0.0; // Since the last summary
+        uint32_t intervalSamples = 0;
+    };
+
+private:
+    struct FrameQueries {
+        const char* names[MAX_SCOPES_PER_FRAME];
+        uint32_t scopeCount = 0;
+        bool recorded = false; // Has been submitted at least once and not read back yet
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    double nanosecondsPerTick = 1.0;
+    uint64_t timestampMask = ~0ull;
+    uint32_t frameCount = 0;
+    std::vector<FrameQueries> frames;
+    std::vector<PassTiming> passes;
+
+    PassTiming& pass(const char* name) {
+        for (auto& pass : this->passes)
+            if (pass.name == name) return pass;
+        this->passes.push_back({ name });
+        return this->passes.back();
+    }
+
+    void resolve(uint32_t frame) {
+        FrameQueries& queries = this->frames[frame];
+        if (!queries.recorded || queries.scopeCount == 0) return;
+        queries.recorded = false;
+
+        // Pairs of (timestamp, availability), no WAIT_BIT: unavailable results are simply skipped
+        uint64_t results[MAX_SCOPES_PER_FRAME * 2][2];
+        uint32_t queryCount = queries.scopeCount * 2;
+        VkResult result = vkGetQueryPoolResults(this->device, this->queryPool, frame * MAX_SCOPES_PER_FRAME * 2, queryCount,
+            sizeof(results), results, sizeof(results[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (result != VK_SUCCESS && result != VK_NOT_READY) return;
+
+        for (uint32_t scope = 0; scope < queries.scopeCount; ++scope) {
+            const uint64_t* begin = results[scope * 2];
+            const uint64_t* end = results[scope * 2 + 1];
+            if (!begin[1] || !end[1]) continue;
+
+            uint64_t ticks = ((end[0] & this->timestampMask) - (begin[0] & this->timestampMask)) & this->timestampMask;
+            double ms = ticks * this->nanosecondsPerTick / 1e6;
+
+            PassTiming& timing = pass(queries.names[scope]);
+            timing.lastMs = ms;
+            timing.intervalTotalMs += ms;
+            timing.intervalMaxMs = std::max(timing.intervalMaxMs, ms);
+            ++timing.intervalSamples;
+        }
+    }
+
+public:
+    bool enabled() const { return this->queryPool != VK_NULL_HANDLE; }
+
+    // Returns true even if timestamps are unsupported on the queue family, the profiler then just stays disabled
+    bool create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameCount) {
+        this->device = device;
+        this->frameCount = frameCount;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+        if (validBits == 0) {
+            std::cout << " GPU profiler: queue family " << queueFamilyIndex << " does not support timestamps, disabled\n";
+            return true;
+        }
+        this->timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        this->nanosecondsPerTick = properties.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = frameCount * MAX_SCOPES_PER_FRAME * 2;
+
+        if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &this->queryPool) != VK_SUCCESS) {
+            std::cerr << "Failed to create timestamp VkQueryPool\n";
+            return false;
+        }
+
+        this->frames.assign(frameCount, FrameQueries{});
+        return true;
+    }
+
+    void destroy() {
+        if (this->queryPool != VK_NULL_HANDLE) vkDestroyQueryPool(this->device, this->queryPool, nullptr);
+        this->queryPool = VK_NULL_HANDLE;
+    }
+
+    // Must be recorded outside of any rendering block, before the first scope of the frame.
+    // The previous submission of this frame slot must already have been waited on.
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+        if (!enabled()) return;
+
+        resolve(frame);
+
+        FrameQueries& queries = this->frames[frame];
+        queries.scopeCount = 0;
+        queries.recorded = true;
+        vkCmdResetQueryPool(commandBuffer, this->queryPool, frame * MAX_SCOPES_PER_FRAME * 2, MAX_SCOPES_PER_FRAME * 2);
+    }
+
+    // Reads back every frame still in flight, only for when the device is idle (e.g. before the exit summary)
+    void resolveAll() {
+        for (uint32_t frame = 0; frame < this->frames.size(); ++frame) resolve(frame);
+    }
+
+    uint32_t beginScope(VkCommandBuffer commandBuffer, uint32_t frame, const char* name) {
+        if (!enabled()) return UINT32_MAX;
+
+        FrameQueries& queries = this->frames[frame];
+        if (queries.scopeCount == MAX_SCOPES_PER_FRAME) return UINT32_MAX;
+
+        uint32_t scope = queries.scopeCount++;
+        queries.names[scope] = name; // String literals, they outlive the profiler
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->queryPool, (frame * MAX_SCOPES_PER_FRAME + scope) * 2);
+        return scope;
+    }
+
+    void endScope(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t scope) {
+        if (scope == UINT32_MAX) return;
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->queryPool, (frame * MAX_SCOPES_PER_FRAME + scope) * 2 + 1);
+    }
+
+    // GPU time of the most recently resolved frame, 0 if the pass was never seen
+    double passMilliseconds(const char* name) const {
+        for (const auto& pass : this->passes)
+            if (pass.name == name) return pass.lastMs;
+        return 0.0;
+    }
+
+    const std::vector<PassTiming>& passTimings() const { return this->passes; }
+
+    // Prints average/max per pass since the last summary and starts a new interval
+    void printSummary() {
+        if (!enabled() || this->passes.empty()) return;
+
+        std::cout << "\n GPU timings (ms)          avg       max   samples\n";
+        for (auto& pass : this->passes) {
+            double average = pass.intervalSamples ? pass.intervalTotalMs / pass.intervalSamples : 0.0;
+            std::cout << "  " << std::left << std::setw(20) << pass.name << std::right << std::fixed << std::setprecision(4)
+                << std::setw(10) << average << std::setw(10) << pass.intervalMaxMs << std::setw(10) << pass.intervalSamples << "\n";
+            pass.intervalTotalMs = pass.intervalMaxMs = 0.0;
+            pass.intervalSamples = 0;
+        }
+        std::cout << std::defaultfloat;
+    }
+};
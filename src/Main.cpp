@@ -6,18 +6,112 @@
 #include <cstring>
 #include <set>
 #include <fstream>
+#include <limits>
+#include <chrono>
+#include <cmath>
+#ifdef _WIN32
 #include <direct.h>
+#endif
+
+#include "AppOptions.h"
+#include "PipelineCache.h"
+#include "ShaderLibrary.h"
+#include "ShaderCompiler.h"
+#include "GpuProfiler.h"
+#include "FrameStats.h"
+#include "TimelineSemaphore.h"
+#include "BarrierBatch.h"
+#include "ParallelRecorder.h"
+#include "GpuAllocator.h"
+#include "UploadQueue.h"
+#include "VertexLayout.h"
+#include "FrameRingBuffer.h"
+#include "BindlessDescriptors.h"
+#include "UniformRing.h"
+#include "DeviceSelector.h"
+#include "FramePacer.h"
+#include "RenderGraph.h"
+#include "DeletionQueue.h"
+#include "ShaderHotReload.h"
+#include "PipelineVariants.h"
+#include "PipelineLibrary.h"
 
 constexpr uint32_t WIDTH = 1080;
 constexpr uint32_t HEIGHT = 720;
 
 // How many frames you let the CPU start rendering before the GPU is done
-// MAX_FRAMES_IN_FLIGHT: How many frames the CPU can work on at once
-// Swap Chain: How many images are available to render into
-// They are not directly tied, but you need to consider things like: MAX_FRAMES_IN_FLIGHT = min(MAX_FRAMES_IN_FLIGHT, SC.size())
-constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+// Frames in flight: How many frames the CPU can work on at once (--frames-in-flight, up to MAX_FRAMES_IN_FLIGHT)
+// Swap Chain: How many images are available to render into, chosen from the surface capabilities and present mode
+// They are not directly tied: an image can be acquired again while an older frame still renders to it, see imagesInFlight
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+// Matches the inputs of triangle.vert, see Vertex::layout()
+struct Vertex {
+    float position[2];
+    float color[3];
+
+    static VertexLayout layout() {
+        return VertexLayout(sizeof(Vertex))
+            .attribute(0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, position))
+            .attribute(1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color));
+    }
+};
+
+const std::vector<Vertex> triangleVertices = {
+    { {  0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+    { {  0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
+    { { -0.5f,  0.5f }, { 0.0f, 0.0f, 1.0f } }
+};
+const std::vector<uint16_t> triangleIndices = { 0, 1, 2 };
+
+// std430 layout of the instance buffer in triangle.vert, 16 bytes so 10M instances stay at 160 MB per frame
+struct Instance {
+    float offset[2];
+    float scale;
+    uint32_t color; // RGBA8, unpackUnorm4x8 in the shader
+};
+
+// Camera: clip position = instance position * scale + offset
+struct ViewConstants {
+    float offset[2];
+    float scale;
+};
 
-#define RESOURCE(filepath) "..\\..\\src\\" filepath
+// Uniform block (set 1) of triangle.vert and cull.comp, written once per frame into the uniform ring, std140
+struct FrameUniforms {
+    ViewConstants view;
+    float time; // Seconds since start
+};
+
+// Push constants of triangle.vert, per draw data only, buffers are bindless handles (see BindlessDescriptors.h)
+struct DrawConstants {
+    uint32_t instanceBuffer, visibleBuffer; // visibleBuffer only with GPU culling
+};
+
+// Specialization constants of triangle.vert and triangle.frag, one pipeline per combination in use (see PipelineVariants.h)
+struct GraphicsVariant {
+    static constexpr uint32_t ANIMATE = 0;       // constant_id in triangle.vert
+    static constexpr uint32_t SHADING_MODEL = 1; // constant_id in triangle.frag
+    static constexpr uint32_t CULLED = 2;        // constant_id in triangle.vert
+
+    ShadingModel shadingModel = ShadingModel::VertexColor;
+    bool animate = false;
+    bool culled = false; // Fixed for the run, by --gpu-culling
+
+    SpecializationConstants constants() const {
+        return SpecializationConstants()
+            .set(ANIMATE, this->animate)
+            .set(SHADING_MODEL, static_cast<uint32_t>(this->shadingModel))
+            .set(CULLED, this->culled);
+    }
+};
+
+// Push constants of cull.comp
+struct CullConstants {
+    float boundingRadius; // Of the mesh at instance scale 1
+    uint32_t objectCount;
+    uint32_t instanceBuffer, visibleBuffer, drawCommandBuffer;
+};
 
 #define DEBUG
 #ifdef DEBUG
@@ -32,57 +126,185 @@ constexpr bool enableValidationLayers = false;
 
 class HelloTraingleApp {
 
+    AppOptions options;
+
     // GLFW
-    GLFWwindow* window;
+    GLFWwindow* window = nullptr;
 
 
     // Vulkan
     VkInstance instance; // Connection between Vulkan and the main program
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE; // The GPU picked to run on
     VkDevice device; // After selecting a Physical Device, create a logical device to interface with it
     std::vector<const char*> deviceExtensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
 
+    uint32_t graphicsQueueFamilyIndex = 0, presentQueueFamilyIndex = 0, computeQueueFamilyIndex = 0, transferQueueFamilyIndex = 0;
     VkQueue graphicsQueue; // Handle to interact with device graphics queue;
-    VkSurfaceKHR surface; // Handle to interact with window
+    VkQueue transferQueue; // Dedicated copy engine when the device has one, otherwise the graphics queue
+    VkQueue computeQueue; // Async compute queue when the device has a compute family without graphics, otherwise the graphics queue
+    VkSurfaceKHR surface = VK_NULL_HANDLE; // Handle to interact with window
     VkQueue presentQueue; // Handle to interact with window surface queue;
+    bool surfaceMaintenance = false; // VK_EXT_surface_maintenance1 and its dependency are enabled on the instance
+    bool presentFences = false; // VK_EXT_swapchain_maintenance1: every present signals a fence, see recreateSwapChain()
+    std::vector<VkFence> pendingPresentFences; // Signaled by presents to the current swap chain, not seen signaled yet
+    std::vector<VkFence> freePresentFences;
+
+    GpuAllocator allocator; // Every buffer and image memory comes from here, never from vkAllocateMemory directly
+    DeletionQueue deletionQueue; // Objects replaced mid-run, destroyed once the graphics timeline says the GPU is done with them
+    BindlessDescriptors bindless; // Set 0 of every pipeline layout
+    UniformRing uniforms; // Set 1 of every pipeline layout, per frame uniforms, see createFrameUniforms()
+    UploadQueue uploads; // Staging ring feeding the transfer queue, see UploadQueue.h
+
+    VkBuffer vertexBuffer = VK_NULL_HANDLE, indexBuffer = VK_NULL_HANDLE;
+    GpuAllocator::Allocation vertexBufferMemory, indexBufferMemory;
+    uint32_t indexCount = 0;
+
+    FrameRingBuffer instanceRing; // Instance data of every frame in flight, a slice is only written when its data changes
+    bool instanceSliceWritten[MAX_FRAMES_IN_FLIGHT] = {};
+    uint32_t instanceCount = 1;
+    uint32_t instanceHandles[MAX_FRAMES_IN_FLIGHT]; // Bindless handle of each frame's slice
+    uint32_t frameUniformOffset = 0; // Dynamic offset of the recorded frame's FrameUniforms in the uniform ring
+
+    /*
+        GPU culling (--gpu-culling)
+        A compute pass tests every instance against the view and compacts the indices of the survivors into a visible list,
+        counting them into the instanceCount of one instanced indirect draw per mesh. The draw reads its command from
+        GPU memory and the vertex shader finds its instance through the list, so culling keeps the draw instanced.
+        Both buffers have a slice per frame in flight, so the culling of a frame can run while older frames still draw.
+    */
+    bool gpuCulling = false;
+    VkBuffer visibleBuffer = VK_NULL_HANDLE, drawCommandBuffer = VK_NULL_HANDLE;
+    GpuAllocator::Allocation visibleMemory, drawCommandMemory;
+    VkDeviceSize visibleStride = 0, drawCommandStride = 0; // Per frame slice
+    uint32_t visibleHandles[MAX_FRAMES_IN_FLIGHT], drawCommandHandles[MAX_FRAMES_IN_FLIGHT];
+    VkPipelineLayout cullPipelineLayout;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+    float meshBoundingRadius = 0.0f;
+
+    /*
+        Async compute
+        With a compute family separate from graphics, compute passes are submitted to their own queue and the GPU runs them
+        beside the graphics work already queued: the culling of frame N overlaps the rendering of frame N-1.
+        The compute queue signals its own timeline and the graphics submission that consumes the results waits on it,
+        only at the stage that reads them. Without a separate family (e.g. lavapipe) the passes are recorded inline instead.
+    */
+    bool asyncCompute = false;
+    VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer computeCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+    TimelineSemaphore computeTimeline;
 
     VkSurfaceFormatKHR surfaceFormat;
     VkExtent2D extent;
-    VkSwapchainKHR swapChain;
-    std::vector<VkImage> swapChainImages;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    std::vector<VkImage> swapChainImages; // In headless mode these are the offscreen render targets
     std::vector<VkImageView> swapChainImageViews;
+    std::vector<GpuAllocator::Allocation> offscreenImageMemory; // Headless only, swap chain images are owned by the swap chain
 
     VkViewport viewport;
     VkRect2D scissor; // Cut viewport filter >:/
 
-    VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    bool framebufferResized = false; // Set by the GLFW callback, some platforms never report VK_ERROR_OUT_OF_DATE_KHR on resize
+
+#ifdef RUNTIME_SHADER_COMPILER
+    ShaderCompiler shaderCompiler{ this->options.shaderSourceDirectory, this->options.shaderCacheDirectory };
+#endif
+
+    PipelineCache pipelineCache; // Persisted across runs so pipelines are not recompiled on every launch
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    PipelineVariants graphicsVariants; // Every specialization of the triangle pipeline built so far
+    GraphicsVariant graphicsVariant; // From the options, then the M and A keys
+    bool graphicsVariantChanged = false; // Set by the key callback, selected at the next frame boundary
+    VkPipeline graphicsPipeline = VK_NULL_HANDLE; // The active variant, what the frames record with
+    bool pipelineLibraryEnabled = false; // VK_EXT_graphics_pipeline_library, unless unsupported or --no-pipeline-library
+    GraphicsPipelineLibrary pipelineLibrary; // Parts the variants are fast linked from when enabled
+    ShaderHotReload hotReload; // --hot-reload, rebuilds the pipelines in the background when their shaders change
+
+    uint32_t framesInFlight = 2; // Only the first framesInFlight entries of the per frame arrays are used
 
     VkCommandPool commandPool;
     VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+    ParallelRecorder parallelRecorder; // Only created with --record-threads, draws then go through secondary buffers
 
     VkSemaphore imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
-    VkSemaphore renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
-    VkFence inFlightFences[MAX_FRAMES_IN_FLIGHT];
+
+    TimelineSemaphore graphicsTimeline; // Signaled by every graphics queue submission with an increasing value
+    uint64_t frameTimelineValues[MAX_FRAMES_IN_FLIGHT] = {}; // Value the last submission of each frame slot signals
+
+    /*
+        Per swap chain image
+        Present waits on renderFinishedSemaphores, and we only know the semaphore is free again once the same image
+        is acquired again, so it has to belong to the image and not to the frame slot (with MAILBOX images come back in any order).
+        imagesInFlight remembers the timeline value of the last frame that rendered to each image, so a frame that acquires
+        an image still used by an older frame waits for that frame only.
+    */
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    std::vector<uint64_t> imagesInFlight;
+
+    BarrierBatch barriers; // Layout/access state of every image we render to, see BarrierBatch.h
+    RenderGraph renderGraph; // Rebuilt every frame by buildFrameGraph(), places the barriers between the passes
+    GpuProfiler gpuProfiler; // Timestamp queries around every pass recorded in commandBuffers
+    FrameStats frameStats; // CPU time of every phase of mainLoop()
+    FramePacer framePacer; // --fps-limit, and the frame time and jitter actually achieved
 
 public:
-    void run() {
-        initWindow();
-        initVulkan();
-        mainLoop();
+    explicit HelloTraingleApp(const AppOptions& options) : options(options) {}
+
+    // false on any failure, main() turns it into the exit status so headless CI runs can detect breakage
+    bool run() {
+        if (this->options.listDevices) return listDevices();
+        if (!initWindow() || !initVulkan()) return false;
+        bool completed = mainLoop();
         cleanup();
+        return completed;
     }
 
 private:
-    void initWindow() {
-        glfwInit();
+    // Without a window, so presentation isn't checked, but with the swap chain extension still required
+    bool listDevices() {
+        this->options.headless = true; // No WSI instance extensions
+        if (!createInstance()) return false;
+        std::vector<DeviceCandidate> candidates = DeviceSelector::probe(this->instance, VK_NULL_HANDLE, this->deviceExtensions);
+        DeviceSelector::printReport(candidates, DeviceSelector::select(candidates, this->options.device));
+        vkDestroyInstance(this->instance, nullptr);
+        return true;
+    }
+
+    bool initWindow() {
+        // Headless runs (CI, benchmark and render servers) may not even have a display to connect to
+        if (this->options.headless) return true;
+
+        if (!glfwInit()) {
+            std::cerr << "Failed to initialize GLFW\n";
+            return false;
+        }
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
         this->window = glfwCreateWindow(WIDTH, HEIGHT, "Hello Triangle - Vulkan", nullptr, nullptr);
+        if (!this->window) {
+            std::cerr << "Failed to create the GLFW window\n";
+            return false;
+        }
+
+        glfwSetWindowUserPointer(this->window, this);
+        glfwSetFramebufferSizeCallback(this->window, [](GLFWwindow* window, int, int) {
+            static_cast<HelloTraingleApp*>(glfwGetWindowUserPointer(window))->framebufferResized = true;
+        });
+        glfwSetKeyCallback(this->window, [](GLFWwindow* window, int key, int, int action, int) {
+            if (action != GLFW_PRESS) return;
+            HelloTraingleApp* app = static_cast<HelloTraingleApp*>(glfwGetWindowUserPointer(window));
+            GraphicsVariant& variant = app->graphicsVariant;
+            if (key == GLFW_KEY_M)
+                variant.shadingModel = static_cast<ShadingModel>((static_cast<uint32_t>(variant.shadingModel) + 1) % static_cast<uint32_t>(ShadingModel::Count));
+            else if (key == GLFW_KEY_A) variant.animate = !variant.animate;
+            else return;
+            app->graphicsVariantChanged = true;
+        });
+        return true;
     }
 
-    void initVulkan() {
+    bool initVulkan() {
         /*
             Clarifications:
 
@@ -112,6 +334,43 @@ private:
                  So you need to handle that separately
             
         */
+        if (this->options.headless) this->deviceExtensions.clear(); // No presentation, so no VK_KHR_swapchain
+
+        this->framesInFlight = std::clamp(this->options.framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT);
+        if (this->framesInFlight != this->options.framesInFlight)
+            std::cout << " Frames in flight clamped to " << this->framesInFlight << " (1 to " << MAX_FRAMES_IN_FLIGHT << ")\n";
+
+        if (!createInstance()) return false;
+        if (!this->options.headless && !createSurface()) return false;
+        if (!pickPhysicalDevice()) return false;
+        if (!createLogicalDevice()) return false;
+        this->allocator.create(this->device, this->physicalDevice);
+        this->deletionQueue.create(this->device, this->allocator, this->graphicsTimeline);
+        if (!this->pipelineCache.create(this->device, this->physicalDevice, this->options.pipelineCachePath)) return false;
+        if (!(this->options.headless ? createOffscreenTargets() : createSwapChain())) return false;
+        if (!createImageViews()) return false;
+        updateViewport();
+        if (!this->bindless.create(this->device, this->physicalDevice)) return false;
+        if (!createInstanceBuffer()) return false;
+        if (!createFrameUniforms()) return false;
+        if (!createGraphicsPipelineLayout()) return false;
+        if (!createGraphicsVariants()) return false;
+        if (this->gpuCulling && !createCullingPass()) return false;
+        if (!this->uploads.create(this->device, this->allocator, this->transferQueue, this->transferQueueFamilyIndex, this->graphicsQueueFamilyIndex)) return false;
+        if (!createGeometryBuffers()) return false;
+        if (!createCommandBuffers()) return false;
+        this->renderGraph.create(this->device, this->allocator, this->barriers, this->framesInFlight);
+        if (this->options.recordThreads > 0 &&
+            !this->parallelRecorder.create(this->device, this->graphicsQueueFamilyIndex, this->options.recordThreads, this->framesInFlight)) return false;
+        if (!createSyncObjects()) return false;
+        if (!createImageSyncObjects()) return false;
+        if (!this->gpuProfiler.create(this->device, this->physicalDevice, this->graphicsQueueFamilyIndex, this->framesInFlight)) return false;
+        if (this->options.hotReload && !startHotReload()) return false;
+
+        return true;
+    }
+
+    bool createInstance() {
         std::cout << "\n Vulkan Header Version: " << VK_HEADER_VERSION << std::endl;
         std::cout << " Vulkan API Version: " << VK_API_VERSION_VARIANT(VK_HEADER_VERSION_COMPLETE)
             << "." << VK_API_VERSION_MAJOR(VK_HEADER_VERSION_COMPLETE)
@@ -135,13 +394,34 @@ private:
         instanceInfo.pApplicationInfo = &appInfo;
 
         // Vulkan is a platform agnostic API, which means that you need an extension to interface with the window system
+        // Headless rendering needs no WSI extensions at all, which is what lets it run on GPU-less boxes (e.g. lavapipe)
         uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
+        const char** glfwExtensions = nullptr;
 
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        if (!this->options.headless) glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        std::vector<const char*> instanceExtensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+
+        // Optional, VK_EXT_swapchain_maintenance1 on the device depends on them
+        if (!this->options.headless) {
+            uint32_t extensionCount = 0;
+            vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+            std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+            vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+            bool capabilities2 = false, surfaceMaintenance1 = false;
+            for (const auto& extension : availableExtensions) {
+                capabilities2 |= strcmp(extension.extensionName, VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME) == 0;
+                surfaceMaintenance1 |= strcmp(extension.extensionName, VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME) == 0;
+            }
+            this->surfaceMaintenance = capabilities2 && surfaceMaintenance1;
+            if (this->surfaceMaintenance) {
+                instanceExtensions.push_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+                instanceExtensions.push_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+            }
+        }
 
-        instanceInfo.enabledExtensionCount = glfwExtensionCount;
-        instanceInfo.ppEnabledExtensionNames = glfwExtensions;
+        instanceInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
+        instanceInfo.ppEnabledExtensionNames = instanceExtensions.data();
         instanceInfo.enabledLayerCount = 0;
 
         #ifdef DEBUG
@@ -169,9 +449,13 @@ private:
 
         if (vkCreateInstance(&instanceInfo, nullptr, &instance) != VK_SUCCESS) {
             std::cerr << "VkInstance Creation Error\n";
-            return;
+            return false;
         }
 
+        return true;
+    }
+
+    bool createSurface() {
         /*
             Window Surface
             Since Vulkan is a platform agnostic API, it can not interface directly with the window system on its own.
@@ -183,74 +467,24 @@ private:
 
         if (glfwCreateWindowSurface(this->instance, this->window, nullptr, &this->surface) != VK_SUCCESS) {
             std::cerr << "VkSurfaceKHR Creation Error\n";
-            return;
+            return false;
         }
 
-        // Once the instance has been created, need to pick a physical device to run on (GPU)
-        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-
-        uint32_t deviceCount = 0;
-        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-
-        if (!deviceCount) { std::cerr << "Failed to find GPUs with Vulkan support\n"; return; }
-
-        std::vector<VkPhysicalDevice> devices(deviceCount);
-        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
-        physicalDevice = devices[0];
-
-        std::cout << "\n Available Devices:\n";
-        VkPhysicalDeviceProperties deviceProperties;
-        VkPhysicalDeviceFeatures2 deviceFeatures2;
-        VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures{};
-        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
-
-        for (const auto& device : devices) {
-            vkGetPhysicalDeviceProperties(device, &deviceProperties);
-
-            deviceFeatures2 = {};
-            deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
-            deviceFeatures2.pNext = &dynamicRenderingFeatures;
-            vkGetPhysicalDeviceFeatures2(device, &deviceFeatures2);
-            std::cout << "\n - " << deviceProperties.deviceName;
-
-            if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-                // Dedicated Hardware
-                std::cout << " (Discrete)";
-                physicalDevice = device;
-            }
-
-            if (dynamicRenderingFeatures.dynamicRendering) {
-                std::cout << " (Core Dyn. Rendering)";
-            }
-
-            // Check if device extensions (like swap chain) are available
-            uint32_t extensionCount;
-            vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-            std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-            vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
-            std::set<std::string> requiredExtensions(this->deviceExtensions.begin(), this->deviceExtensions.end());
-            for (const auto& extension : availableExtensions) requiredExtensions.erase(extension.extensionName);
-
-            if(requiredExtensions.empty()) std::cout << " (Extensions Available)";
-
-            uint32_t apiVersion = deviceProperties.apiVersion;
-            uint32_t major = VK_VERSION_MAJOR(apiVersion);
-            uint32_t minor = VK_VERSION_MINOR(apiVersion);
-            uint32_t patch = VK_VERSION_PATCH(apiVersion);
-
-            std::cout << " (" << major << "." << minor << "." << patch << ")";
+        return true;
+    }
 
-            std::cout << std::endl;
-        }
-        std::cout << std::endl;
+    bool pickPhysicalDevice() {
+        // Once the instance has been created, need to pick a physical device to run on (GPU), see DeviceSelector.h
+        std::vector<DeviceCandidate> candidates = DeviceSelector::probe(this->instance, this->surface, this->deviceExtensions);
+        const DeviceCandidate* selected = DeviceSelector::select(candidates, this->options.device);
+        DeviceSelector::printReport(candidates, selected);
+        if (!selected) return false;
+        physicalDevice = selected->device;
 
         // Check supported Queue Families
         uint32_t queueFamilyCount = 0;
         vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
 
-        uint32_t graphicsQueueFamilyIndex = 0, presentQueueFamilyIndex = 0, computeQueueFamilyIndex = 0;
         std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
         vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
         for (uint32_t i = 0; i < queueFamilies.size(); ++i) {
@@ -259,10 +493,11 @@ private:
                 std::cout << " Queue family " << i << " supports graphics operations\n";
             };
             if (queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-                computeQueueFamilyIndex = i;
                 std::cout << " Queue family " << i << " supports compute operations\n";
             }
 
+            if (this->options.headless) continue;
+
             VkBool32 presentSupport = false;
             vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, this->surface, &presentSupport);
             if (presentSupport) {
@@ -271,33 +506,143 @@ private:
             }
         }
 
-        
+        if (this->options.headless) presentQueueFamilyIndex = graphicsQueueFamilyIndex; // Nothing is presented, keep a single family
+
+        // A compute family without graphics gets its own hardware queue (async compute), the graphics family is the fallback
+        computeQueueFamilyIndex = graphicsQueueFamilyIndex;
+        for (uint32_t i = 0; i < queueFamilies.size(); ++i) {
+            if ((queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+                computeQueueFamilyIndex = i;
+                std::cout << " Queue family " << i << " is a dedicated compute family\n";
+                break;
+            }
+        }
+        this->asyncCompute = this->options.asyncCompute && computeQueueFamilyIndex != graphicsQueueFamilyIndex;
+
+        // A family that can copy but neither draw nor dispatch is a DMA engine, uploads there run beside rendering.
+        // Every graphics family also supports transfers, so that is the fallback
+        transferQueueFamilyIndex = graphicsQueueFamilyIndex;
+        for (uint32_t i = 0; i < queueFamilies.size(); ++i) {
+            if ((queueFamilies[i].queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                !(queueFamilies[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                transferQueueFamilyIndex = i;
+                std::cout << " Queue family " << i << " is a dedicated transfer family\n";
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    bool supportsGpuCulling() {
+        VkPhysicalDeviceVulkan11Properties vulkan11Properties{};
+        vulkan11Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &vulkan11Properties;
+        vkGetPhysicalDeviceProperties2(this->physicalDevice, &properties);
+
+        return (vulkan11Properties.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+            (vulkan11Properties.subgroupSupportedOperations & VK_SUBGROUP_FEATURE_BALLOT_BIT);
+    }
+
+    bool supportsPresentFences() {
+        if (!this->surfaceMaintenance) return false;
+
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(this->physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(this->physicalDevice, nullptr, &extensionCount, extensions.data());
+        if (std::none_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties& extension) {
+            return strcmp(extension.extensionName, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME) == 0; })) return false;
+
+        VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchainMaintenanceFeatures{};
+        swapchainMaintenanceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &swapchainMaintenanceFeatures;
+        vkGetPhysicalDeviceFeatures2(this->physicalDevice, &features);
+        return swapchainMaintenanceFeatures.swapchainMaintenance1;
+    }
+
+    bool createLogicalDevice() {
         // Create queues of any family
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> queueFamilyIndicies = { graphicsQueueFamilyIndex, presentQueueFamilyIndex, computeQueueFamilyIndex };
+        std::set<uint32_t> queueFamilyIndicies = { graphicsQueueFamilyIndex, presentQueueFamilyIndex, computeQueueFamilyIndex, transferQueueFamilyIndex };
+        float queuePriority = 1.0f; // Must outlive vkCreateDevice, not just the loop iteration
         for (uint32_t queueFamilyIndex : queueFamilyIndicies) {
             VkDeviceQueueCreateInfo queueCreateInfo{};
             queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
             queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
             queueCreateInfo.queueCount = 1;
-            float queuePriority = 1.0f;
             queueCreateInfo.pQueuePriorities = &queuePriority;
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
-        // Enable Dynamic Rendering extension on device
-        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
-        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+        this->gpuCulling = this->options.gpuCulling && supportsGpuCulling();
+        if (this->options.gpuCulling && !this->gpuCulling)
+            std::cout << " GPU culling needs compute subgroup ballots, drawing everything instead\n";
+
+        // Optional, without it every new pipeline variant is a complete (slow) pipeline creation
+        bool fastLinking = false;
+        this->pipelineLibraryEnabled = this->options.pipelineLibrary && GraphicsPipelineLibrary::supported(this->physicalDevice, fastLinking);
+        if (this->pipelineLibraryEnabled) {
+            this->deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+            this->deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+            std::cout << " Graphics pipeline library: variants are linked from parts" << (fastLinking ? "" : " (the driver reports no fast linking)") << "\n";
+        }
+        else if (this->options.pipelineLibrary)
+            std::cout << " VK_EXT_graphics_pipeline_library is not supported, building complete pipelines\n";
+
+        // Optional, without it a swap chain recreation waits for the present queue to idle
+        this->presentFences = !this->options.headless && supportsPresentFences();
+        if (this->presentFences) this->deviceExtensions.push_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+
+        // Timeline semaphores are core since 1.2 and required by 1.3, but the feature still has to be enabled
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vulkan12Features.timelineSemaphore = VK_TRUE;
+
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures{};
+        pipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        pipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+        if (this->pipelineLibraryEnabled) vulkan12Features.pNext = &pipelineLibraryFeatures;
+
+        VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchainMaintenanceFeatures{};
+        swapchainMaintenanceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+        swapchainMaintenanceFeatures.swapchainMaintenance1 = VK_TRUE;
+        if (this->presentFences) {
+            swapchainMaintenanceFeatures.pNext = vulkan12Features.pNext;
+            vulkan12Features.pNext = &swapchainMaintenanceFeatures;
+        }
+
+        VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+        supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 supportedFeatures{};
+        supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures.pNext = &supportedVulkan12Features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+        if (!BindlessDescriptors::requiredFeatures(supportedVulkan12Features, vulkan12Features)) {
+            std::cerr << "The device does not support the descriptor indexing features the bindless descriptor set needs\n";
+            return false;
+        }
+
+        // Dynamic rendering and synchronization2 are both core (and required) in 1.3
+        VkPhysicalDeviceVulkan13Features vulkan13Features{};
+        VkPhysicalDeviceFeatures2 deviceFeatures2{};
+        vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        vulkan13Features.dynamicRendering = VK_TRUE;
+        vulkan13Features.synchronization2 = VK_TRUE;
+        vulkan13Features.pNext = &vulkan12Features;
 
         deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
         deviceFeatures2.features = {};
-        deviceFeatures2.pNext = &dynamicRenderingFeatures;
+        deviceFeatures2.pNext = &vulkan13Features;
 
         //VkPhysicalDeviceFeatures deviceFeatures{};
 
         VkDeviceCreateInfo deviceInfo{};
         deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        deviceInfo.pNext = &dynamicRenderingFeatures;
         deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
         deviceInfo.queueCreateInfoCount = queueCreateInfos.size();
 
@@ -308,12 +653,50 @@ private:
 
         if (vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &this->device) != VK_SUCCESS) {
             std::cerr << "VkDevice Creation Error\n";
-            return;
+            return false;
         }
 
         vkGetDeviceQueue(this->device, graphicsQueueFamilyIndex, 0, &this->graphicsQueue); // 0 because we created only 1 queue of this family
         vkGetDeviceQueue(this->device, presentQueueFamilyIndex, 0, &this->presentQueue);
+        vkGetDeviceQueue(this->device, transferQueueFamilyIndex, 0, &this->transferQueue);
+        vkGetDeviceQueue(this->device, computeQueueFamilyIndex, 0, &this->computeQueue);
+
+        return true;
+    }
+
+    // Follows options.presentPolicy, falling back to FIFO, the only mode every surface supports (presentModes[0] may be anything)
+    VkPresentModeKHR choosePresentMode(const std::vector<VkPresentModeKHR>& presentModes) const {
+        std::vector<VkPresentModeKHR> preferred;
+        switch (this->options.presentPolicy) {
+        case PresentPolicy::Fifo: break;
+        case PresentPolicy::FifoRelaxed: preferred = { VK_PRESENT_MODE_FIFO_RELAXED_KHR }; break;
+        case PresentPolicy::Mailbox: preferred = { VK_PRESENT_MODE_MAILBOX_KHR }; break;
+        case PresentPolicy::Immediate: preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR }; break;
+        case PresentPolicy::Uncapped: preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR }; break;
+        }
+
+        auto name = [](VkPresentModeKHR mode) {
+            switch (mode) {
+            case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+            case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+            case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+            default: return "FIFO";
+            }
+        };
 
+        VkPresentModeKHR chosen = VK_PRESENT_MODE_FIFO_KHR;
+        for (VkPresentModeKHR mode : preferred)
+            if (std::find(presentModes.begin(), presentModes.end(), mode) != presentModes.end()) { chosen = mode; break; }
+
+        if (this->swapChain == VK_NULL_HANDLE) { // Once, not on every resize
+            if (!preferred.empty() && chosen == VK_PRESENT_MODE_FIFO_KHR)
+                std::cout << " Present mode " << name(preferred.front()) << " is not supported by the surface, falling back to FIFO\n";
+            else std::cout << " Present mode: " << name(chosen) << "\n";
+        }
+        return chosen;
+    }
+
+    bool createSwapChain() {
         /*
             SWAP CHAIN
             Vulkan does not have the concept of a "default framebuffer", hence it requires an infrastructure
@@ -376,10 +759,10 @@ private:
 
         if (!formatCount || !presentModeCount) {
             std::cerr << "Chosen physical device swap chain doesn't support current window surface or is not adequate\n";
-            return;
+            return false;
         }
 
-        VkPresentModeKHR presentMode = presentModes[0];
+        VkPresentModeKHR presentMode = choosePresentMode(presentModes);
         this->surfaceFormat = formats[0];
         this->extent = capabilities.currentExtent;
 
@@ -388,12 +771,7 @@ private:
                 this->surfaceFormat = sFormat;
                 break;
             }
-       
-        for (const auto& pMode : presentModes)
-            if (pMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                presentMode = pMode;
-                break;
-            }
+
 
         if (capabilities.currentExtent.width == std::numeric_limits<uint32_t>::max()) {
             int width, height;
@@ -409,9 +787,12 @@ private:
             this->extent = actualExtent;
         }
 
-        uint32_t imageCount = MAX_FRAMES_IN_FLIGHT; // How many images to have in the swap chain
-        //(capabilities.maxImageCount > 0 && capabilities.minImageCount + 1 > capabilities.maxImageCount) ?
-        //capabilities.maxImageCount : capabilities.minImageCount + 1; 
+        // How many images to have in the swap chain, independent of the frames in flight.
+        // One more than the minimum so we don't have to wait on the presentation engine to release an image,
+        // and MAILBOX needs at least 3 (one on screen, one queued, one to render into) or it can't replace anything
+        uint32_t imageCount = capabilities.minImageCount + 1;
+        if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR) imageCount = std::max(imageCount, 3u);
+        if (capabilities.maxImageCount > 0) imageCount = std::min(imageCount, capabilities.maxImageCount); // 0 means no limit
 
         VkSwapchainCreateInfoKHR swapChainInfo{};
         swapChainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -430,7 +811,9 @@ private:
         swapChainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
         swapChainInfo.presentMode = presentMode;
         swapChainInfo.clipped = VK_TRUE;
-        swapChainInfo.oldSwapchain = VK_NULL_HANDLE;
+        // On recreation the old swap chain is handed over, the driver can then reuse its resources and
+        // keep presenting its queued images while the new one is created
+        swapChainInfo.oldSwapchain = this->swapChain;
 
         if (graphicsQueueFamilyIndex != presentQueueFamilyIndex) {
             swapChainInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
@@ -444,15 +827,113 @@ private:
             swapChainInfo.pQueueFamilyIndices = nullptr; // Optional
         }
 
-        if (vkCreateSwapchainKHR(this->device, &swapChainInfo, nullptr, &this->swapChain) != VK_SUCCESS) {
+        VkSwapchainKHR newSwapChain;
+        if (vkCreateSwapchainKHR(this->device, &swapChainInfo, nullptr, &newSwapChain) != VK_SUCCESS) {
             std::cerr << "VkSwapchainKHR Creation Error\n";
-            return;
+            return false;
         }
+        this->swapChain = newSwapChain;
 
         vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
         swapChainImages.resize(imageCount);
         vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
 
+        if (swapChainInfo.oldSwapchain == VK_NULL_HANDLE)
+            std::cout << " Swap chain: " << imageCount << " images, " << this->framesInFlight << " frames in flight\n";
+
+        return true;
+    }
+
+    /*
+        Swap chain recreation
+        A resize (or the compositor deciding so) makes the swap chain out of date, acquire and present then return
+        VK_ERROR_OUT_OF_DATE_KHR or VK_SUBOPTIMAL_KHR. Only what depends on the swap chain is rebuilt:
+        its images, their views and the viewport/scissor. The pipeline uses dynamic viewport/scissor and
+        dynamic rendering, so it survives untouched.
+
+        The old swap chain is not destroyed right away, that would need a vkDeviceWaitIdle and a visible hitch on every
+        resize event. Frames in flight may still render to its images, so its views are retired into the deletion queue
+        and destroyed once the timeline says those frames are done.
+        Its queued presents are a different matter: each one is queued after the submission it waits on, and the timeline
+        reaching that submission says nothing about the present, which may still be waiting on its renderFinishedSemaphore
+        (FIFO, several images queued). The swap chain and those semaphores must outlive every present using them.
+        With VK_EXT_swapchain_maintenance1 each present signals a fence, and they are retired with the fences of the presents
+        still pending. Without it there is no way to tell, so we wait for the present queue to idle: resizes are rare.
+    */
+    bool recreateSwapChain() {
+        // A minimized window has a 0x0 framebuffer and no valid swap chain extent, sleep until it comes back
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(this->window, &width, &height);
+        while ((width == 0 || height == 0) && !glfwWindowShouldClose(this->window)) {
+            glfwWaitEvents();
+            glfwGetFramebufferSize(this->window, &width, &height);
+        }
+        this->framebufferResized = false;
+        if (width == 0 || height == 0) return true; // Closed while minimized, mainLoop() exits on its own
+
+        std::vector<VkFence> oldPresentFences;
+        if (this->presentFences) oldPresentFences.swap(this->pendingPresentFences);
+        else vkQueueWaitIdle(this->presentQueue);
+
+        VkSwapchainKHR oldSwapChain = this->swapChain;
+        std::vector<VkSemaphore> oldSemaphores = std::move(this->renderFinishedSemaphores);
+        for (auto imageView : this->swapChainImageViews) this->deletionQueue.retire(imageView);
+        this->swapChainImageViews.clear();
+        this->renderFinishedSemaphores.clear();
+        for (auto image : this->swapChainImages) this->barriers.forget(image);
+
+        bool created = createSwapChain() && createImageViews() && createImageSyncObjects();
+        // Even on failure, it was handed to oldSwapchain. After its views
+        this->deletionQueue.retire(std::move(oldPresentFences), [this, oldSwapChain, oldSemaphores] {
+            for (VkSemaphore semaphore : oldSemaphores) vkDestroySemaphore(this->device, semaphore, nullptr);
+            vkDestroySwapchainKHR(this->device, oldSwapChain, nullptr);
+        });
+        if (this->swapChain == oldSwapChain) this->swapChain = VK_NULL_HANDLE; // Creation failed, the queue owns it now, not cleanup()
+        if (!created) return false;
+
+        updateViewport();
+        return true;
+    }
+
+    /*
+        Headless rendering
+        Without a window there is no surface to present to, and so no swap chain to own the images we render into.
+        Instead we allocate a small ring of plain VkImages ourselves and cycle through them the same way the swap chain would,
+        which keeps the frame code (barriers, dynamic rendering, submission) identical between both modes.
+        The final layout is TRANSFER_SRC_OPTIMAL instead of PRESENT_SRC_KHR, ready to be copied out for readback.
+    */
+    bool createOffscreenTargets() {
+        this->surfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM; // Mandatory color attachment format on every implementation
+        this->surfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+        this->extent = { WIDTH, HEIGHT };
+
+        this->swapChainImages.resize(this->framesInFlight);
+        this->offscreenImageMemory.resize(this->framesInFlight);
+
+        for (size_t i = 0; i < this->swapChainImages.size(); ++i) {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = this->surfaceFormat.format;
+            imageInfo.extent = { this->extent.width, this->extent.height, 1 };
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            if (!this->allocator.createImage(imageInfo, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->swapChainImages[i], this->offscreenImageMemory[i])) {
+                std::cerr << "Offscreen VkImage Creation Error\n";
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool createImageViews() {
         /*
             To use any VkImage, including those in the swap chain,
             in the render pipeline we have to create a VkImageView object.
@@ -467,7 +948,7 @@ private:
             imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
             imageViewInfo.image = swapChainImages[i];
             imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            imageViewInfo.format = swapChainInfo.imageFormat;
+            imageViewInfo.format = this->surfaceFormat.format;
             imageViewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
             imageViewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
             imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -480,439 +961,1008 @@ private:
             
             if(vkCreateImageView(this->device, &imageViewInfo, nullptr, &this->swapChainImageViews[i]) != VK_SUCCESS) {
                 std::cerr << "VkImageView Creation Error\n";
-                return;
+                return false;
             }
+        }
 
-            /*
-                An image view is sufficient to start using an image as a texture, 
-                but it's not quite ready to be used as a render target just yet. 
-                That requires one more step of indirection, known as a framebuffer
-            */
+        return true;
+    }
 
-            // Graphics Pipeline
-            /*
-                The graphics pipeline in Vulkan is almost completely immutable,
-                so you must recreate the pipeline from scratch if you want to change shaders,
-                bind different framebuffers or change the blend function.
-                The disadvantage is that you'll have to create a number of pipelines
-                that represent all of the different combinations of states you want to use in your rendering operations.
-                However, because all of the operations you'll be doing in the pipeline are known in advance,
-                the driver can optimize for it much better.
-                
-                While most of the pipeline state needs to be baked into the pipeline state,
-                a limited amount of the state can actually be changed without recreating the pipeline at draw time.
-                Examples are the size of the viewport, line width and blend constants.
-
-                NOTE: In Vulakn 1.3 Dynamic State pipelines are almost fully covered, 
-                      (VK_EXT_extended_dynamic_state1, VK_EXT_extended_dynamic_state2, VK_EXT_extended_dynamic_state3)
-                      that means that the concept of a immutable pipeline is not accurate anymore.
-                      But we'll follow the old way just to get the full vulkan experience
-                        
-            */
+    // Viewport and scissor are dynamic state, so they only have to follow the extent, not the pipeline
+    void updateViewport() {
+        this->viewport.x = 0.0f;
+        this->viewport.y = 0.0f;
+        this->viewport.width = (float)this->extent.width;
+        this->viewport.height = (float)this->extent.height;
+        this->viewport.minDepth = 0.0f;
+        this->viewport.maxDepth = 1.0f;
+
+        this->scissor.offset = { 0, 0 };
+        this->scissor.extent = this->extent;
+    }
 
-            // Gotta change cmake.txt
-            // char buffer[FILENAME_MAX];
-            // _getcwd(buffer, FILENAME_MAX);
-            // std::cout << "Current working directory: " << buffer << std::endl;
-            
-            // Shaders
-            system(RESOURCE("Shaders\\runtime_compile.bat"));
+    bool createGraphicsPipelineLayout() {
+        /*
+            Pipeline layout
+            You can use uniform values in shaders. These uniform values need to be specified during pipeline creation by creating a VkPipelineLayout object.
+            Set 0 is the global bindless set, resources are reached through the handles in the push constants
+            Set 1 is the frame's uniform block in the uniform ring
+            Push constants hold the small per draw data, they are the cheapest way to change anything between two draws
+        */
 
-            std::ifstream vsFile(RESOURCE("Shaders\\vert.spv"), std::ios::ate | std::ios::binary);
-            if(!vsFile.is_open()) { std::cerr << "Failed to read vertex shader file\n"; return; }
-            std::ifstream fsFile(RESOURCE("Shaders\\frag.spv"), std::ios::ate | std::ios::binary);
-            if (!fsFile.is_open()) { std::cerr << "Failed to load fragment shader file\n"; return; }
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        VkDescriptorSetLayout setLayouts[] = { this->bindless.layout(), this->uniforms.layout() };
+        VkPushConstantRange drawRange{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants) };
+        pipelineLayoutInfo.setLayoutCount = 2;
+        pipelineLayoutInfo.pSetLayouts = setLayouts;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &drawRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &this->pipelineLayout) != VK_SUCCESS) { 
+            std::cerr << "Failed to create VkCreatePipelineLayout\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    // Builds one variant, also called by the shader hot reload thread, so it only reads state that is fixed after initVulkan()
+    // parts: 0 for a complete pipeline, or the pipeline library part to build (see PipelineLibrary.h)
+    bool createGraphicsPipeline(VkFormat colorFormat, const SpecializationConstants& constants, VkGraphicsPipelineLibraryFlagsEXT parts, VkPipeline& pipeline) {
+        /*
+            An image view is sufficient to start using an image as a texture, 
+            but it's not quite ready to be used as a render target just yet. 
+            That requires one more step of indirection, known as a framebuffer
+        */
+
+        // Graphics Pipeline
+        /*
+            The graphics pipeline in Vulkan is almost completely immutable,
+            so you must recreate the pipeline from scratch if you want to change shaders,
+            bind different framebuffers or change the blend function.
+            The disadvantage is that you'll have to create a number of pipelines
+            that represent all of the different combinations of states you want to use in your rendering operations.
+            However, because all of the operations you'll be doing in the pipeline are known in advance,
+            the driver can optimize for it much better.
             
-            size_t vsFileSize = static_cast<size_t>(vsFile.tellg()), fsFileSize = static_cast<size_t>(fsFile.tellg());
-            std::vector<char> vsBuffer(vsFileSize);
-            std::vector<char> fsBuffer(fsFileSize);
-
-            vsFile.seekg(0);
-            vsFile.read(vsBuffer.data(), vsFileSize);
-            fsFile.seekg(0);
-            fsFile.read(fsBuffer.data(), fsFileSize);
-
-            vsFile.close();
-            fsFile.close();
-
-            // Before we can pass the code to the pipeline, we have to wrap it in a VkShaderModule object
-            VkShaderModule vsShaderModule;
-            VkShaderModuleCreateInfo vsShaderModuleInfo{};
-            vsShaderModuleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-            vsShaderModuleInfo.codeSize = vsBuffer.size();
-            vsShaderModuleInfo.pCode = reinterpret_cast<const uint32_t*>(vsBuffer.data());
-            if (vkCreateShaderModule(this->device, &vsShaderModuleInfo, nullptr, &vsShaderModule) != VK_SUCCESS) { std::cerr << "Failed to create VkShaderModule (vertex)\n"; return; }
-
-            VkShaderModule fsShaderModule;
-            VkShaderModuleCreateInfo fsShaderModuleInfo{};
-            fsShaderModuleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-            fsShaderModuleInfo.codeSize = fsBuffer.size();
-            fsShaderModuleInfo.pCode = reinterpret_cast<const uint32_t*>(fsBuffer.data());
-            if (vkCreateShaderModule(this->device, &fsShaderModuleInfo, nullptr, &fsShaderModule) != VK_SUCCESS) { std::cerr << "Failed to create VkShaderModule (fragment)\n"; return; }
-
-            // To actually use the shaders we'll need to assign them to a specific pipeline stage through VkPipelineShaderStageCreateInfo structures as part of the actual pipeline creation process.
-            VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-            vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-            vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-            vertShaderStageInfo.module = vsShaderModule;
-            vertShaderStageInfo.pName = "main";
-
-            VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-            fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-            fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-            fragShaderStageInfo.module = fsShaderModule;
-            fragShaderStageInfo.pName = "main";
-
-            VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-            // Dynamic State
-            std::vector<VkDynamicState> dynamicStates = {
-                VK_DYNAMIC_STATE_VIEWPORT,
-                VK_DYNAMIC_STATE_SCISSOR
-            };
+            While most of the pipeline state needs to be baked into the pipeline state,
+            a limited amount of the state can actually be changed without recreating the pipeline at draw time.
+            Examples are the size of the viewport, line width and blend constants.
+
+            NOTE: In Vulakn 1.3 Dynamic State pipelines are almost fully covered, 
+                  (VK_EXT_extended_dynamic_state1, VK_EXT_extended_dynamic_state2, VK_EXT_extended_dynamic_state3)
+                  that means that the concept of a immutable pipeline is not accurate anymore.
+                  But we'll follow the old way just to get the full vulkan experience
+                    
+        */
 
-            VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
-            dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-            dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-            dynamicStateInfo.pDynamicStates = dynamicStates.data();
+        // Shaders
+        // Compiled to SPIR-V by CMake and embedded in the executable, unless a development override directory was given
+        // A library part only gets the stage it compiles, the vertex input and fragment output parts have none
+        bool vertexStage = !parts || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+        bool fragmentStage = !parts || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+        ShaderCode vsCode, fsCode;
+        if (vertexStage && !loadShader("triangle.vert", vsCode)) return false;
+        if (fragmentStage && !loadShader("triangle.frag", fsCode)) return false;
+
+        // Before we can pass the code to the pipeline, we have to wrap it in a VkShaderModule object
+        VkShaderModule vsShaderModule = VK_NULL_HANDLE;
+        VkShaderModuleCreateInfo vsShaderModuleInfo{};
+        vsShaderModuleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        vsShaderModuleInfo.codeSize = vsCode.size;
+        vsShaderModuleInfo.pCode = vsCode.data();
+        if (vertexStage && vkCreateShaderModule(this->device, &vsShaderModuleInfo, nullptr, &vsShaderModule) != VK_SUCCESS) { std::cerr << "Failed to create VkShaderModule (vertex)\n"; return false; }
+
+        VkShaderModule fsShaderModule = VK_NULL_HANDLE;
+        VkShaderModuleCreateInfo fsShaderModuleInfo{};
+        fsShaderModuleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        fsShaderModuleInfo.codeSize = fsCode.size;
+        fsShaderModuleInfo.pCode = fsCode.data();
+        if (fragmentStage && vkCreateShaderModule(this->device, &fsShaderModuleInfo, nullptr, &fsShaderModule) != VK_SUCCESS) {
+            std::cerr << "Failed to create VkShaderModule (fragment)\n";
+            vkDestroyShaderModule(this->device, vsShaderModule, nullptr);
+            return false;
+        }
 
-            // Vertex Input Layout
-            /*
-                The VkPipelineVertexInputStateCreateInfo structure describes the format of the vertex data that will be passed to the vertex shader.
-                It describes this in roughly two ways:
+        // The values of the constant_id declarations of both stages, the driver compiles the variant with them folded in
+        VkSpecializationInfo specializationInfo = constants.info();
+
+        // To actually use the shaders we'll need to assign them to a specific pipeline stage through VkPipelineShaderStageCreateInfo structures as part of the actual pipeline creation process.
+        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = vsShaderModule;
+        vertShaderStageInfo.pName = "main";
+        vertShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageInfo.module = fsShaderModule;
+        fragShaderStageInfo.pName = "main";
+        fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+        std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+        if (vertexStage) shaderStages.push_back(vertShaderStageInfo);
+        if (fragmentStage) shaderStages.push_back(fragShaderStageInfo);
+
+        // Dynamic State
+        std::vector<VkDynamicState> dynamicStates = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+
+        VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
+        dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicStateInfo.pDynamicStates = dynamicStates.data();
+
+        // Vertex Input Layout
+        /*
+            The VkPipelineVertexInputStateCreateInfo structure describes the format of the vertex data that will be passed to the vertex shader.
+            It describes this in roughly two ways:
 
-                    Bindings: spacing between data and whether the data is per-vertex or per-instance (see instancing)
-                    Attribute descriptions: type of the attributes passed to the vertex shader, which binding to load them from and at which offset
+                Bindings: spacing between data and whether the data is per-vertex or per-instance (see instancing)
+                Attribute descriptions: type of the attributes passed to the vertex shader, which binding to load them from and at which offset
 
-                Because we're hard coding the vertex data directly in the vertex shader,
-                we'll fill in this structure to specify that there is no vertex data to load for now.
-            */
+            Both come from the layout declared next to the Vertex struct, so they can't drift apart from the C++ side.
+        */
 
-            VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-            vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-            vertexInputInfo.vertexBindingDescriptionCount = 0;
-            vertexInputInfo.pVertexBindingDescriptions = nullptr;
-            vertexInputInfo.vertexAttributeDescriptionCount = 0;
-            vertexInputInfo.pVertexAttributeDescriptions = nullptr;
+        VertexLayout vertexLayout = Vertex::layout(); // Must outlive vkCreateGraphicsPipelines
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = vertexLayout.inputState();
 
-            // The VkPipelineInputAssemblyStateCreateInfo struct describes two things:
-            // what kind of geometry will be drawn from the vertices and if primitive restart should be enabled (aka. index buffer/EBO)
+        // The VkPipelineInputAssemblyStateCreateInfo struct describes two things:
+        // what kind of geometry will be drawn from the vertices and if primitive restart should be enabled (aka. index buffer/EBO)
 
-            VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
-            inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-            inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-            inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
+        inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-            this->viewport.x = 0.0f;
-            this->viewport.y = 0.0f;
-            this->viewport.width = (float)this->extent.width;
-            this->viewport.height = (float)this->extent.height;
-            this->viewport.minDepth = 0.0f;
-            this->viewport.maxDepth = 1.0f;
+        VkPipelineViewportStateCreateInfo viewportStateInfo{};
+        viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportStateInfo.viewportCount = 1;
+        viewportStateInfo.scissorCount = 1;
 
-            this->scissor.offset = { 0, 0 };
-            this->scissor.extent = this->extent;
+        /*
+            The rasterizer takes the geometry that is shaped by the vertices from the vertex shader and
+            turns it into fragments to be colored by the fragment shader. It also performs depth testing,
+            face culling and the scissor test, and it can be configured to output fragments that
+            fill entire polygons or just the edges (wireframe rendering).
+            All this is configured using the VkPipelineRasterizationStateCreateInfo structure.
+        */
 
-            VkPipelineViewportStateCreateInfo viewportStateInfo{};
-            viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-            viewportStateInfo.viewportCount = 1;
-            viewportStateInfo.scissorCount = 1;
+        VkPipelineRasterizationStateCreateInfo rasterizerInfo{};
+        rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizerInfo.depthClampEnable = VK_FALSE;
+        rasterizerInfo.rasterizerDiscardEnable = VK_FALSE; // Do not discard geometry
+        rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizerInfo.lineWidth = 1.0f;
+        rasterizerInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizerInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterizerInfo.depthBiasEnable = VK_FALSE;
+        rasterizerInfo.depthBiasConstantFactor = 0.0f; // Optional
+        rasterizerInfo.depthBiasClamp = 0.0f; // Optional
+        rasterizerInfo.depthBiasSlopeFactor = 0.0f; // Optional
 
-            /*
-                The rasterizer takes the geometry that is shaped by the vertices from the vertex shader and
-                turns it into fragments to be colored by the fragment shader. It also performs depth testing,
-                face culling and the scissor test, and it can be configured to output fragments that
-                fill entire polygons or just the edges (wireframe rendering).
-                All this is configured using the VkPipelineRasterizationStateCreateInfo structure.
-            */
+        /*
+            Multisampling
+            The VkPipelineMultisampleStateCreateInfo struct configures multisampling, which is one of the ways to perform anti-aliasing.
+            It works by combining the fragment shader results of multiple polygons that rasterize to the same pixel
+        */
 
-            VkPipelineRasterizationStateCreateInfo rasterizerInfo{};
-            rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-            rasterizerInfo.depthClampEnable = VK_FALSE;
-            rasterizerInfo.rasterizerDiscardEnable = VK_FALSE; // Do not discard geometry
-            rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
-            rasterizerInfo.lineWidth = 1.0f;
-            rasterizerInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-            rasterizerInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
-            rasterizerInfo.depthBiasEnable = VK_FALSE;
-            rasterizerInfo.depthBiasConstantFactor = 0.0f; // Optional
-            rasterizerInfo.depthBiasClamp = 0.0f; // Optional
-            rasterizerInfo.depthBiasSlopeFactor = 0.0f; // Optional
+        VkPipelineMultisampleStateCreateInfo multisamplingInfo{}; // Disabled for now
+        multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisamplingInfo.sampleShadingEnable = VK_FALSE;
+        multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisamplingInfo.minSampleShading = 1.0f; // Optional
+        multisamplingInfo.pSampleMask = nullptr; // Optional
+        multisamplingInfo.alphaToCoverageEnable = VK_FALSE; // Optional
+        multisamplingInfo.alphaToOneEnable = VK_FALSE; // Optional
 
-            /*
-                Multisampling
-                The VkPipelineMultisampleStateCreateInfo struct configures multisampling, which is one of the ways to perform anti-aliasing.
-                It works by combining the fragment shader results of multiple polygons that rasterize to the same pixel
-            */
+        /*
+            Color blending
+            After a fragment shader has returned a color, it needs to be combined with the color that is already in the framebuffer.
+            This transformation is known as color blending and there are two ways to do it:
+
+                Mix the old and new value to produce a final color
+                Combine the old and new value using a bitwise operation
+
+            There are two types of structs to configure color blending.
+            VkPipelineColorBlendAttachmentState contains the configuration per attached framebuffer
+            VkPipelineColorBlendStateCreateInfo contains the global color blending settings
+
+
+            There's this line in the fragment shader file: "layout(location = 0) out vec4 outColor;"
+
+            The "0" there means the first framebuffer attachment. But you can have multiple of these lines,
+            numbered from 0 to 7, I think (8 in total). So in the same shader you could render to multiple of these attachments,
+            for example for Deferred Rendering. "Deferred" means putting it off to a later time,
+            sometime later during the frame lifetime before presenting the finished image to the screen.
+            Multiple framebuffer attachments would make up what's commonly known as a "G-buffer" ("g" for geometric)
+            where you render the normals, frag pos, material id, albedo, specular, roughness, metallic, velocity buffer... whatever you want,
+            all within the same shader, each to their own framebuffer attachment. Then read from each of these (as textures)
+            later on towards the end of the frame lifetime where you combine them (using a different shader) to produce the final pixel on the screen,
+            to save on (potentially) expensive lighting calculations. Deferred Rendering is often used because with Forward Rendering
+            you'd be throwing away a lot of (potentially) expensive lighting calculations after they are discarded by
+            the rasterizer stage using the depth buffer (fragments behind other fragments), so you'd "defer" these calculations to later where they will only run once,
+            for just the visible fragments. LearnOpenGL.com has a nice chapter on it.
+        */
 
-            VkPipelineMultisampleStateCreateInfo multisamplingInfo{}; // Disabled for now
-            multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-            multisamplingInfo.sampleShadingEnable = VK_FALSE;
-            multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-            multisamplingInfo.minSampleShading = 1.0f; // Optional
-            multisamplingInfo.pSampleMask = nullptr; // Optional
-            multisamplingInfo.alphaToCoverageEnable = VK_FALSE; // Optional
-            multisamplingInfo.alphaToOneEnable = VK_FALSE; // Optional
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE; // VK_TRUE
+        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // VK_BLEND_FACTOR_SRC_ALPHA
+        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA
+        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+        VkPipelineColorBlendStateCreateInfo colorBlendingInfo{}; // Array of structures for all of the framebuffers
+        colorBlendingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlendingInfo.logicOpEnable = VK_FALSE;
+        colorBlendingInfo.logicOp = VK_LOGIC_OP_COPY;
+        colorBlendingInfo.attachmentCount = 1;
+        colorBlendingInfo.pAttachments = &colorBlendAttachment;
+        colorBlendingInfo.blendConstants[0] = 0.0f;
+        colorBlendingInfo.blendConstants[1] = 0.0f;
+        colorBlendingInfo.blendConstants[2] = 0.0f;
+        colorBlendingInfo.blendConstants[3] = 0.0f;
+
+        // Pipeline layout: created once by createGraphicsPipelineLayout(), shared by every variant and library part
+
+        // Dynamic Rendering VS Renderpasses
+        // Framebuffers and Renderpasses: Classic way do deal with rendering, bad nowadays, only good for mobile
+        // Dynamic Rendering is the way
+        /*
+            For Bloom (or any postprocessing):
+
+            Bloom typically involves multiple render passes:
+                Render the scene to a high dynamic range (HDR) image
+                Extract bright areas => blur => combine back
+            In traditional Vulkan:
+                Each pass would need a VkFramebuffer
+                Each framebuffer is tied to a VkRenderPass, image view, size, etc.
+            With Dynamic Rendering
+                Create render targets as VkImage + VkImageView
+                Specify which image view to use as a color attachment in VkRenderingAttachmentInfo
+                Begin/End rendering blocks per pass
+
+            There is no framebuffer  you "build" the framebuffer at runtime.
+        */
 
-            /*
-                Color blending
-                After a fragment shader has returned a color, it needs to be combined with the color that is already in the framebuffer.
-                This transformation is known as color blending and there are two ways to do it:
-
-                    Mix the old and new value to produce a final color
-                    Combine the old and new value using a bitwise operation
-
-                There are two types of structs to configure color blending.
-                VkPipelineColorBlendAttachmentState contains the configuration per attached framebuffer
-                VkPipelineColorBlendStateCreateInfo contains the global color blending settings
-
-
-                There's this line in the fragment shader file: "layout(location = 0) out vec4 outColor;"
-
-                The "0" there means the first framebuffer attachment. But you can have multiple of these lines,
-                numbered from 0 to 7, I think (8 in total). So in the same shader you could render to multiple of these attachments,
-                for example for Deferred Rendering. "Deferred" means putting it off to a later time,
-                sometime later during the frame lifetime before presenting the finished image to the screen.
-                Multiple framebuffer attachments would make up what's commonly known as a "G-buffer" ("g" for geometric)
-                where you render the normals, frag pos, material id, albedo, specular, roughness, metallic, velocity buffer... whatever you want,
-                all within the same shader, each to their own framebuffer attachment. Then read from each of these (as textures)
-                later on towards the end of the frame lifetime where you combine them (using a different shader) to produce the final pixel on the screen,
-                to save on (potentially) expensive lighting calculations. Deferred Rendering is often used because with Forward Rendering
-                you'd be throwing away a lot of (potentially) expensive lighting calculations after they are discarded by
-                the rasterizer stage using the depth buffer (fragments behind other fragments), so you'd "defer" these calculations to later where they will only run once,
-                for just the visible fragments. LearnOpenGL.com has a nice chapter on it.
-            */
+        VkPipelineRenderingCreateInfo pipelineRenderingInfo{};
+        pipelineRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        pipelineRenderingInfo.colorAttachmentCount = 1;
+        pipelineRenderingInfo.pColorAttachmentFormats = &colorFormat;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &pipelineRenderingInfo; // this is essential for dynamic rendering!
+        pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+        pipelineInfo.pViewportState = &viewportStateInfo;
+        pipelineInfo.pRasterizationState = &rasterizerInfo;
+        pipelineInfo.pMultisampleState = &multisamplingInfo;
+        pipelineInfo.pDepthStencilState = nullptr;
+        pipelineInfo.pColorBlendState = &colorBlendingInfo;
+        pipelineInfo.pDynamicState = &dynamicStateInfo;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
+        pipelineInfo.subpass = 0;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        // Creation feedback (core in 1.3) tells us whether the pipeline came out of the cache or was compiled from scratch
+        VkPipelineCreationFeedback creationFeedback{};
+        VkPipelineCreationFeedbackCreateInfo creationFeedbackInfo{};
+        creationFeedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+        creationFeedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+        pipelineRenderingInfo.pNext = &creationFeedbackInfo;
+
+        // A library part keeps only the state of its part, the rest is ignored. It retains what a link time optimized
+        // link needs, so the fast linked pipeline can be replaced by a fully optimized one later
+        VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+        libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+        libraryInfo.flags = parts;
+        if (parts) {
+            creationFeedbackInfo.pNext = &libraryInfo;
+            pipelineInfo.flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+        }
 
-            VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-            colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-            colorBlendAttachment.blendEnable = VK_FALSE; // VK_TRUE
-            colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // VK_BLEND_FACTOR_SRC_ALPHA
-            colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA
-            colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-            colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-            colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-            colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-            VkPipelineColorBlendStateCreateInfo colorBlendingInfo{}; // Array of structures for all of the framebuffers
-            colorBlendingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-            colorBlendingInfo.logicOpEnable = VK_FALSE;
-            colorBlendingInfo.logicOp = VK_LOGIC_OP_COPY;
-            colorBlendingInfo.attachmentCount = 1;
-            colorBlendingInfo.pAttachments = &colorBlendAttachment;
-            colorBlendingInfo.blendConstants[0] = 0.0f;
-            colorBlendingInfo.blendConstants[1] = 0.0f;
-            colorBlendingInfo.blendConstants[2] = 0.0f;
-            colorBlendingInfo.blendConstants[3] = 0.0f;
+        auto creationStart = std::chrono::steady_clock::now();
+        VkResult result = vkCreateGraphicsPipelines(this->device, this->pipelineCache.handle(), 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(device, vsShaderModule, nullptr);
+        vkDestroyShaderModule(device, fsShaderModule, nullptr);
+        if (result != VK_SUCCESS) {
+            std::cerr << "Failed to create VkCreatePipeline\n";
+            return false;
+        }
+        double creationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - creationStart).count();
+        const char* part = "";
+        switch (parts) {
+        case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT: part = " vertex input"; break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT: part = " pre-rasterization"; break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT: part = " fragment shader"; break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT: part = " fragment output"; break;
+        default: break;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "triangle%s %016llx", part, static_cast<unsigned long long>(constants.key()));
+        this->pipelineCache.recordCreation(name, creationFeedback, creationMs);
 
-            /*
-                Pipeline layout
-                You can use uniform values in shaders. These uniform values need to be specified during pipeline creation by creating a VkPipelineLayout object.
-                Even though we won't be using them until a future chapter, we are still required to create an empty pipeline layout
-            */
+        return true;
+    }
 
-            VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-            pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-            pipelineLayoutInfo.setLayoutCount = 0;
-            pipelineLayoutInfo.pSetLayouts = nullptr;
-            pipelineLayoutInfo.pushConstantRangeCount = 0;
-            pipelineLayoutInfo.pPushConstantRanges = nullptr;
+    bool createGraphicsVariants() {
+        // Complete and self contained, so the hot reload thread can build with it too
+        VkFormat colorFormat = this->surfaceFormat.format;
+        PipelineVariants::Build monolithic = [this, colorFormat](const SpecializationConstants& constants, VkPipeline& pipeline) {
+            return createGraphicsPipeline(colorFormat, constants, 0, pipeline);
+        };
+
+        if (this->pipelineLibraryEnabled) {
+            this->pipelineLibrary.create(this->device, this->pipelineCache.handle(), this->pipelineLayout,
+                [this, colorFormat](VkGraphicsPipelineLibraryFlagsEXT part, const SpecializationConstants& constants, VkPipeline& library) {
+                    return createGraphicsPipeline(colorFormat, constants, part, library);
+                });
+
+            // Each stage's part only sees the constants of its own stage, so a part is shared by every variant agreeing on them
+            this->graphicsVariants.create(this->device, [this](const SpecializationConstants& constants, VkPipeline& pipeline) {
+                return this->pipelineLibrary.link(constants.key(), constants.subset({ GraphicsVariant::ANIMATE, GraphicsVariant::CULLED }),
+                    constants.subset({ GraphicsVariant::SHADING_MODEL }), pipeline);
+            }, monolithic);
+        }
+        else this->graphicsVariants.create(this->device, monolithic);
 
-            if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &this->pipelineLayout) != VK_SUCCESS) { 
-                std::cerr << "Failed to create VkCreatePipelineLayout\n";
-                return;
-            }
+        this->graphicsVariant.shadingModel = this->options.shadingModel;
+        this->graphicsVariant.animate = this->options.animate;
+        this->graphicsVariant.culled = this->gpuCulling;
+        this->graphicsPipeline = this->graphicsVariants.select(this->graphicsVariant.constants());
+        return this->graphicsPipeline != VK_NULL_HANDLE;
+    }
 
-            // Dynamic Rendering VS Renderpasses
-            // Framebuffers and Renderpasses: Classic way do deal with rendering, bad nowadays, only good for mobile
-            // Dynamic Rendering is the way
-            /*
-                For Bloom (or any postprocessing):
-
-                Bloom typically involves multiple render passes:
-                    Render the scene to a high dynamic range (HDR) image
-                    Extract bright areas => blur => combine back
-                In traditional Vulkan:
-                    Each pass would need a VkFramebuffer
-                    Each framebuffer is tied to a VkRenderPass, image view, size, etc.
-                With Dynamic Rendering
-                    Create render targets as VkImage + VkImageView
-                    Specify which image view to use as a color attachment in VkRenderingAttachmentInfo
-                    Begin/End rendering blocks per pass
-
-                There is no framebuffer  you "build" the framebuffer at runtime.
-            */
+    // Development builds compile GLSL in-process (through the shader cache), release builds use the embedded SPIR-V
+    bool loadShader(const char* name, ShaderCode& code) {
+#ifdef RUNTIME_SHADER_COMPILER
+        if (this->options.shaderDirectory.empty()) return this->shaderCompiler.compile(name, {}, code);
+#endif
+        return loadShaderCode(name, this->options.shaderDirectory, code);
+    }
 
-            VkPipelineRenderingCreateInfo pipelineRenderingInfo{};
-            pipelineRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
-            pipelineRenderingInfo.colorAttachmentCount = 1;
-            pipelineRenderingInfo.pColorAttachmentFormats = &this->surfaceFormat.format;
-
-            VkGraphicsPipelineCreateInfo pipelineInfo{};
-            pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-            pipelineInfo.pNext = &pipelineRenderingInfo; // this is essential for dynamic rendering!
-            pipelineInfo.stageCount = 2;
-            pipelineInfo.pStages = shaderStages;
-            pipelineInfo.pVertexInputState = &vertexInputInfo;
-            pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-            pipelineInfo.pViewportState = &viewportStateInfo;
-            pipelineInfo.pRasterizationState = &rasterizerInfo;
-            pipelineInfo.pMultisampleState = &multisamplingInfo;
-            pipelineInfo.pDepthStencilState = nullptr;
-            pipelineInfo.pColorBlendState = &colorBlendingInfo;
-            pipelineInfo.pDynamicState = &dynamicStateInfo;
-            pipelineInfo.layout = pipelineLayout;
-            pipelineInfo.renderPass = VK_NULL_HANDLE;
-            pipelineInfo.subpass = 0;
-            pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-            pipelineInfo.basePipelineIndex = -1;
-
-            if (vkCreateGraphicsPipelines(this->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &this->graphicsPipeline) != VK_SUCCESS) {
-                std::cerr << "Failed to create VkCreatePipeline\n";
-                return;
-            }
+    // Watches where loadShader() reads from: the SPIR-V of --shader-dir, or the GLSL the in-process compiler builds
+    bool startHotReload() {
+        std::string directory = this->options.shaderDirectory;
+#ifdef RUNTIME_SHADER_COMPILER
+        if (directory.empty()) directory = this->options.shaderSourceDirectory;
+#endif
+        if (directory.empty()) {
+            std::cout << " Shader hot reload needs --shader-dir or the runtime shader compiler, the embedded shaders can't change\n";
+            return true;
+        }
 
-            vkDestroyShaderModule(device, vsShaderModule, nullptr);
-            vkDestroyShaderModule(device, fsShaderModule, nullptr);
+        // Only the active variant is rebuilt, the others were built from the old shaders and are dropped
+        this->hotReload.add("triangle", { "triangle.vert", "triangle.frag" },
+            [this](VkPipeline& pipeline) { return this->graphicsVariants.rebuild(pipeline); },
+            [this](VkPipeline pipeline, DeletionQueue& deletionQueue) {
+                if (this->pipelineLibraryEnabled) this->pipelineLibrary.clear(); // The parts hold the old shaders too
+                this->graphicsVariants.replace(pipeline, deletionQueue);
+                this->graphicsPipeline = this->graphicsVariants.active();
+            });
+        if (this->gpuCulling)
+            this->hotReload.add("cull", { "cull.comp" }, this->cullPipeline, [this](VkPipeline& pipeline) { return createCullPipeline(pipeline); });
+        return this->hotReload.start(this->device, directory);
+    }
 
-            // Rendering
+    bool createCommandBuffers() {
+        // Rendering
 
-            /*
-                Command Buffers
-                Commands in Vulkan, like drawing operations and memory transfers, are not executed directly using function calls.
-                You have to record all of the operations you want to perform in command buffer objects.
-                The advantage of this is that when we are ready to tell the Vulkan what we want to do,
-                all of the commands are submitted together and Vulkan can more efficiently process the commands
-                since all of them are available together. In addition, this allows command recording to
-                happen in multiple threads if so desired.
-
-                We have to create a command pool before we can create command buffers.
-                Command pools manage the memory that is used to store the buffers
-                and command buffers are allocated from them
-
-                Flags:
-                VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: Hint that command buffers are rerecorded with new commands very often (may change memory allocation behavior)
-                VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command buffers to be rerecorded individually, without this flag they all have to be reset together
-                
-                Command buffers are executed by submitting them on one of the device queues,
-                like the graphics and presentation queues we retrieved.
-                Each command pool can only allocate command buffers that are submitted on a single type of queue.
-                We're going to record commands for drawing, which is why we've chosen the graphics queue family
-            */
+        /*
+            Command Buffers
+            Commands in Vulkan, like drawing operations and memory transfers, are not executed directly using function calls.
+            You have to record all of the operations you want to perform in command buffer objects.
+            The advantage of this is that when we are ready to tell the Vulkan what we want to do,
+            all of the commands are submitted together and Vulkan can more efficiently process the commands
+            since all of them are available together. In addition, this allows command recording to
+            happen in multiple threads if so desired.
+
+            We have to create a command pool before we can create command buffers.
+            Command pools manage the memory that is used to store the buffers
+            and command buffers are allocated from them
+
+            Flags:
+            VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: Hint that command buffers are rerecorded with new commands very often (may change memory allocation behavior)
+            VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command buffers to be rerecorded individually, without this flag they all have to be reset together
+            
+            Command buffers are executed by submitting them on one of the device queues,
+            like the graphics and presentation queues we retrieved.
+            Each command pool can only allocate command buffers that are submitted on a single type of queue.
+            We're going to record commands for drawing, which is why we've chosen the graphics queue family
+        */
 
 
-            VkCommandPoolCreateInfo cmdPoolInfo{};
-            cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-            cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-            cmdPoolInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
+        VkCommandPoolCreateInfo cmdPoolInfo{};
+        cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        cmdPoolInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
 
-            if (vkCreateCommandPool(this->device, &cmdPoolInfo, nullptr, &this->commandPool) != VK_SUCCESS) {
-                std::cerr << "Failed to create VkCreateCommandPool\n";
-                return;
-            }
+        if (vkCreateCommandPool(this->device, &cmdPoolInfo, nullptr, &this->commandPool) != VK_SUCCESS) {
+            std::cerr << "Failed to create VkCreateCommandPool\n";
+            return false;
+        }
 
 
-            /*
-                Command buffer allocation
-                Command buffers will be automatically freed when their command pool is destroyed, so we don't need explicit cleanup.
-            
-                The level parameter specifies if the allocated command buffers are primary or secondary command buffers.
+        /*
+            Command buffer allocation
+            Command buffers will be automatically freed when their command pool is destroyed, so we don't need explicit cleanup.
+        
+            The level parameter specifies if the allocated command buffers are primary or secondary command buffers.
 
-                    VK_COMMAND_BUFFER_LEVEL_PRIMARY: Can be submitted to a queue for execution, but cannot be called from other command buffers.
-                    VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly, but can be called from primary command buffers.
+                VK_COMMAND_BUFFER_LEVEL_PRIMARY: Can be submitted to a queue for execution, but cannot be called from other command buffers.
+                VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly, but can be called from primary command buffers.
 
-                You can imagine that it's helpful to reuse common operations from primary command buffers.
-                Since we are only allocating one command buffer, the commandBufferCount parameter is just one
-            */
+            You can imagine that it's helpful to reuse common operations from primary command buffers.
+            Since we are only allocating one command buffer, the commandBufferCount parameter is just one
+        */
 
-            VkCommandBufferAllocateInfo cmdBufferAllocInfo{};
-            cmdBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            cmdBufferAllocInfo.commandPool = this->commandPool;
-            cmdBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-            cmdBufferAllocInfo.commandBufferCount = (uint32_t)MAX_FRAMES_IN_FLIGHT;
+        VkCommandBufferAllocateInfo cmdBufferAllocInfo{};
+        cmdBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmdBufferAllocInfo.commandPool = this->commandPool;
+        cmdBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cmdBufferAllocInfo.commandBufferCount = this->framesInFlight;
 
-            if (vkAllocateCommandBuffers(this->device, &cmdBufferAllocInfo, this->commandBuffers) != VK_SUCCESS) {
-                std::cerr << "Failed to allocate with VkAllocateCommandBuffers\n";
-                return;
-            }
+        if (vkAllocateCommandBuffers(this->device, &cmdBufferAllocInfo, this->commandBuffers) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate with VkAllocateCommandBuffers\n";
+            return false;
+        }
 
-            /*
-                Synchronization
+        return true;
+    }
 
-                A core design philosophy in Vulkan is that synchronization of execution on the GPU is explicit.
-                The order of operations is up to us to define using various synchronization primitives
-                which tell the driver the order we want things to run in.
-                This means that many Vulkan API calls which start executing work on the GPU are asynchronous,
-                the functions will return before the operation has finished.
+    bool createSyncObjects() {
+        /*
+            Synchronization
 
-                There are a number of events that we need to order explicitly because they happen on the GPU, such as:
+            A core design philosophy in Vulkan is that synchronization of execution on the GPU is explicit.
+            The order of operations is up to us to define using various synchronization primitives
+            which tell the driver the order we want things to run in.
+            This means that many Vulkan API calls which start executing work on the GPU are asynchronous,
+            the functions will return before the operation has finished.
 
-                    Acquire an image from the swap chain
-                    Execute commands that draw onto the acquired image
-                    Present that image to the screen for presentation, returning it to the swapchain
+            There are a number of events that we need to order explicitly because they happen on the GPU, such as:
 
-                Each of these events is set in motion using a single function call, but are all executed asynchronously.
-                The function calls will return before the operations are actually finished and the order of execution is also undefined.
-                That is unfortunate, because each of the operations depends on the previous one finishing.
-                Thus we need to explore which primitives we can use to achieve the desired ordering.
-            
+                Acquire an image from the swap chain
+                Execute commands that draw onto the acquired image
+                Present that image to the screen for presentation, returning it to the swapchain
 
-                Semaphores
+            Each of these events is set in motion using a single function call, but are all executed asynchronously.
+            The function calls will return before the operations are actually finished and the order of execution is also undefined.
+            That is unfortunate, because each of the operations depends on the previous one finishing.
+            Thus we need to explore which primitives we can use to achieve the desired ordering.
+        
 
-                A semaphore is used to add order between queue operations.
-                Queue operations refer to the work we submit to a queue,
-                either in a command buffer or from within a function as we will see later.
-                Examples of queues are the graphics queue and the presentation queue.
-                Semaphores are used both to order work inside the same queue and between different queues.
+            Semaphores
 
-                There happens to be two kinds of semaphores in Vulkan, binary and timeline.
+            A semaphore is used to add order between queue operations.
+            Queue operations refer to the work we submit to a queue,
+            either in a command buffer or from within a function as we will see later.
+            Examples of queues are the graphics queue and the presentation queue.
+            Semaphores are used both to order work inside the same queue and between different queues.
 
-                A semaphore is either unsignaled or signaled. It begins life as unsignaled.
+            There happens to be two kinds of semaphores in Vulkan, binary and timeline.
 
+            A semaphore is either unsignaled or signaled. It begins life as unsignaled.
 
-                Fences
 
-                A fence has a similar purpose, in that it is used to synchronize execution,
-                but it is for ordering the execution on the CPU, otherwise known as the host.
-                Simply put, if the host needs to know when the GPU has finished something, we use a fence.
+            Fences
 
-                What to choose?
+            A fence has a similar purpose, in that it is used to synchronize execution,
+            but it is for ordering the execution on the CPU, otherwise known as the host.
+            Simply put, if the host needs to know when the GPU has finished something, we use a fence.
 
-                We have two synchronization primitives to use and conveniently two places to apply synchronization:
-                Swapchain operations and waiting for the previous frame to finish.
-                We want to use semaphores for swapchain operations because they happen on the GPU,
-                thus we don't want to make the host wait around if we can help it.
-                For waiting on the previous frame to finish, we want to use fences for the opposite reason,
-                because we need the host to wait. This is so we don't draw more than one frame at a time.
-                Because we re-record the command buffer every frame,
-                we cannot record the next frame's work to the command buffer until the current frame has finished executing,
-                as we don't want to overwrite the current contents of the command buffer while the GPU is using it.
-        
-                ULTIMATE SUM UP:
-                    SEMAPHORE: You want the GPU to wait
-                    FENCES: You want the CPU to wait
-            */
+            What to choose?
+
+            We have two synchronization primitives to use and conveniently two places to apply synchronization:
+            Swapchain operations and waiting for the previous frame to finish.
+            We want to use semaphores for swapchain operations because they happen on the GPU,
+            thus we don't want to make the host wait around if we can help it.
+            For waiting on the previous frame to finish, we want to use fences for the opposite reason,
+            because we need the host to wait. This is so we don't draw more than one frame at a time.
+            Because we re-record the command buffer every frame,
+            we cannot record the next frame's work to the command buffer until the current frame has finished executing,
+            as we don't want to overwrite the current contents of the command buffer while the GPU is using it.
+    
+            ULTIMATE SUM UP:
+                SEMAPHORE: You want the GPU to wait
+                FENCES: You want the CPU to wait
+
+            Timeline semaphores
+
+            A timeline semaphore can do the job of the fences and does it better: instead of one fence per frame
+            that has to be reset before every reuse, a single semaphore counts up with every submission,
+            and the CPU can wait for or poll any past value with vkWaitSemaphores/vkGetSemaphoreCounterValue.
+            Presentation still only understands binary semaphores, so the swap chain keeps using those.
+        */
 
-            VkSemaphoreCreateInfo semaphoreInfo{};
-            semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
+        for (size_t i = 0; i < this->framesInFlight; ++i) {
+            if (vkCreateSemaphore(this->device, &semaphoreInfo, nullptr, this->imageAvailableSemaphores+i) != VK_SUCCESS) {
+                std::cerr << "Failed to create a VkSemaphore\n";
+                return false;
+            }
+        }
+
+        return this->graphicsTimeline.create(this->device);
+    }
+
+    // A fence for the next present (VK_EXT_swapchain_maintenance1), the ones seen signaled are reused first
+    bool acquirePresentFence(VkFence& fence) {
+        for (size_t i = 0; i < this->pendingPresentFences.size(); ) {
+            if (vkGetFenceStatus(this->device, this->pendingPresentFences[i]) == VK_SUCCESS) {
+                this->freePresentFences.push_back(this->pendingPresentFences[i]);
+                this->pendingPresentFences.erase(this->pendingPresentFences.begin() + i);
+            }
+            else ++i;
+        }
+
+        if (!this->freePresentFences.empty()) {
+            fence = this->freePresentFences.back();
+            this->freePresentFences.pop_back();
+            vkResetFences(this->device, 1, &fence);
+        }
+        else {
             VkFenceCreateInfo fenceInfo{};
             fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // Workaround to avoid vkWaitForFences block the first frame forever
-
-            for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-                if (vkCreateSemaphore(this->device, &semaphoreInfo, nullptr, this->imageAvailableSemaphores+i) != VK_SUCCESS ||
-                    vkCreateSemaphore(this->device, &semaphoreInfo, nullptr, this->renderFinishedSemaphores+i) != VK_SUCCESS ||
-                    vkCreateFence(this->device, &fenceInfo, nullptr, this->inFlightFences+i) != VK_SUCCESS) {
-                    std::cerr << "Failed to create a VkSemaphore or VkFence\n";
-                    return;
-                }
+            if (vkCreateFence(this->device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+                std::cerr << "Failed to create a present VkFence\n";
+                return false;
+            }
+        }
+
+        this->pendingPresentFences.push_back(fence);
+        return true;
+    }
+
+    // Per image objects, recreated with the swap chain since the image count may change
+    bool createImageSyncObjects() {
+        this->imagesInFlight.assign(this->swapChainImages.size(), 0);
+        if (this->options.headless) return true; // Nothing is presented, so nothing to signal
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        this->renderFinishedSemaphores.resize(this->swapChainImages.size());
+        for (auto& semaphore : this->renderFinishedSemaphores) {
+            if (vkCreateSemaphore(this->device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+                std::cerr << "Failed to create a VkSemaphore\n";
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /*
+        Vertex and index buffers
+        They live in device local memory and are filled through the upload queue. The copies run on the transfer queue,
+        the first frame acquires the buffers on the graphics queue and waits for the copies at the vertex input stage only,
+        so nothing blocks here while the data is in flight.
+    */
+    bool createGeometryBuffers() {
+        VkDeviceSize vertexSize = sizeof(Vertex) * triangleVertices.size();
+        VkDeviceSize indexSize = sizeof(uint16_t) * triangleIndices.size();
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // Ownership is transferred explicitly, CONCURRENT would be slower to access
+
+        bufferInfo.size = vertexSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if (!this->allocator.createBuffer(bufferInfo, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vertexBuffer, this->vertexBufferMemory)) return false;
+
+        bufferInfo.size = indexSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if (!this->allocator.createBuffer(bufferInfo, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->indexBuffer, this->indexBufferMemory)) return false;
+
+        if (!this->uploads.uploadBuffer(this->vertexBuffer, 0, triangleVertices.data(), vertexSize,
+            VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT)) return false;
+        if (!this->uploads.uploadBuffer(this->indexBuffer, 0, triangleIndices.data(), indexSize,
+            VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT)) return false;
+        this->indexCount = static_cast<uint32_t>(triangleIndices.size());
+
+        return this->uploads.submit();
+    }
+
+    /*
+        Instancing
+        All triangles share the vertex and index buffers, what differs per triangle (offset, scale, color) lives in a storage
+        buffer that the vertex shader indexes with gl_InstanceIndex, so any number of them is one vkCmdDrawIndexed.
+        The instance data lives in that frame's slice of a FrameRingBuffer, each slice is its own bindless storage buffer
+        and the frame passes the handle of its slice. The per frame animation runs in the vertex shader, so a slice is
+        written once: at millions of instances, regenerating them on one core would be all the benchmark measured.
+    */
+    bool createInstanceBuffer() {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+        this->instanceCount = this->options.instanceCount;
+        uint64_t maxInstances = properties.limits.maxStorageBufferRange / sizeof(Instance);
+        if (this->instanceCount > maxInstances) {
+            this->instanceCount = static_cast<uint32_t>(maxInstances);
+            std::cout << " Instances clamped to " << this->instanceCount << " (maxStorageBufferRange)\n";
+        }
+
+        // The async culling pass reads the instances on the compute queue
+        std::vector<uint32_t> queueFamilies = { this->graphicsQueueFamilyIndex };
+        if (this->gpuCulling && this->asyncCompute) queueFamilies.push_back(this->computeQueueFamilyIndex);
+
+        if (!this->instanceRing.create(this->device, this->physicalDevice, this->allocator, sizeof(Instance) * this->instanceCount,
+            this->framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, properties.limits.minStorageBufferOffsetAlignment, queueFamilies)) return false;
+
+        // One storage buffer descriptor per slice, the vertex shader gets the frame's handle in its push constants
+        for (uint32_t frame = 0; frame < this->framesInFlight; ++frame) {
+            this->instanceHandles[frame] = this->bindless.addBuffer(this->instanceRing.buffer(), this->instanceRing.offset(frame), this->instanceRing.sliceSize());
+            if (this->instanceHandles[frame] == BindlessDescriptors::INVALID_HANDLE) return false;
+        }
+
+        if (this->instanceCount > 1)
+            std::cout << " Instancing: " << this->instanceCount << " triangles, " << (this->instanceRing.sliceSize() >> 10) << " KiB per frame slot, written once\n";
+        return true;
+    }
+
+    /*
+        Frame uniforms
+        Data shared by every draw of a frame (camera, time) is written once per frame into the frame's region of a
+        UniformRing and bound as set 1 with its dynamic offset, push constants only carry what changes per draw.
+        The culling pass reads the same block, from the compute queue when culling runs async.
+    */
+    bool createFrameUniforms() {
+        std::vector<uint32_t> queueFamilies = { this->graphicsQueueFamilyIndex };
+        if (this->gpuCulling && this->asyncCompute) queueFamilies.push_back(this->computeQueueFamilyIndex);
+
+        // 64 KiB a frame is far more than FrameUniforms needs, the rest is room for per draw or per pass blocks
+        return this->uniforms.create(this->device, this->physicalDevice, this->allocator, 64 << 10, this->framesInFlight,
+            1 << 10, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, queueFamilies);
+    }
+
+    /*
+        Culling pass
+        cull.comp reads the instance ring (same slice handle as the vertex shader), writes the index of every visible
+        instance to the visible list and counts them into the instanceCount of the frame's VkDrawIndexedIndirectCommand.
+        One instanced draw per mesh, however many instances survive, instead of a draw per instance.
+        Inline, the buffers are written and read within one submission, as a render graph pass (see buildFrameGraph()).
+        Async, they are written on the compute queue and the timeline wait of the graphics submission orders the read.
+        Either way each frame slot has its own slice, whose previous reader is complete once the slot's timeline value was waited.
+    */
+    bool createCullingPass() {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+        for (const Vertex& vertex : triangleVertices)
+            this->meshBoundingRadius = std::max(this->meshBoundingRadius, std::hypot(vertex.position[0], vertex.position[1]));
+
+        VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+        // An index is smaller than an Instance, so the visible list fits in maxStorageBufferRange whenever the instances do
+        this->visibleStride = (sizeof(uint32_t) * this->instanceCount + alignment - 1) & ~(alignment - 1);
+        this->drawCommandStride = (sizeof(VkDrawIndexedIndirectCommand) + alignment - 1) & ~(alignment - 1);
+
+        // Written by the compute queue and read by the graphics queue every frame, see FrameRingBuffer.h for why CONCURRENT
+        uint32_t queueFamilies[] = { this->graphicsQueueFamilyIndex, this->computeQueueFamilyIndex };
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.sharingMode = this->asyncCompute ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+        bufferInfo.queueFamilyIndexCount = this->asyncCompute ? 2 : 0;
+        bufferInfo.pQueueFamilyIndices = queueFamilies;
+        bufferInfo.size = this->visibleStride * this->framesInFlight;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        if (!this->allocator.createBuffer(bufferInfo, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->visibleBuffer, this->visibleMemory)) return false;
+
+        bufferInfo.size = this->drawCommandStride * this->framesInFlight;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if (!this->allocator.createBuffer(bufferInfo, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->drawCommandBuffer, this->drawCommandMemory)) return false;
+
+        for (uint32_t frame = 0; frame < this->framesInFlight; ++frame) {
+            this->visibleHandles[frame] = this->bindless.addBuffer(this->visibleBuffer, this->visibleStride * frame, this->visibleStride);
+            this->drawCommandHandles[frame] = this->bindless.addBuffer(this->drawCommandBuffer, this->drawCommandStride * frame, sizeof(VkDrawIndexedIndirectCommand));
+            if (this->visibleHandles[frame] == BindlessDescriptors::INVALID_HANDLE ||
+                this->drawCommandHandles[frame] == BindlessDescriptors::INVALID_HANDLE) return false;
+        }
+
+        VkDescriptorSetLayout setLayouts[] = { this->bindless.layout(), this->uniforms.layout() };
+        VkPushConstantRange cullRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants) };
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 2;
+        pipelineLayoutInfo.pSetLayouts = setLayouts;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &cullRange;
+        if (vkCreatePipelineLayout(this->device, &pipelineLayoutInfo, nullptr, &this->cullPipelineLayout) != VK_SUCCESS) {
+            std::cerr << "Failed to create the culling VkPipelineLayout\n";
+            return false;
+        }
+
+        if (!createCullPipeline(this->cullPipeline)) return false;
+
+        if (this->asyncCompute) {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+            poolInfo.queueFamilyIndex = this->computeQueueFamilyIndex;
+            if (vkCreateCommandPool(this->device, &poolInfo, nullptr, &this->computeCommandPool) != VK_SUCCESS) {
+                std::cerr << "Failed to create the compute VkCommandPool\n";
+                return false;
+            }
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = this->computeCommandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = this->framesInFlight;
+            if (vkAllocateCommandBuffers(this->device, &allocInfo, this->computeCommandBuffers) != VK_SUCCESS) {
+                std::cerr << "Failed to allocate the compute command buffers\n";
+                return false;
             }
+
+            if (!this->computeTimeline.create(this->device)) return false;
         }
 
+        std::cout << " GPU culling: " << this->instanceCount << " objects, bounding radius " << this->meshBoundingRadius
+            << (this->asyncCompute ? ", async on queue family " : ", inline on queue family ")
+            << (this->asyncCompute ? this->computeQueueFamilyIndex : this->graphicsQueueFamilyIndex) << "\n";
+        return true;
+    }
 
+    // Also called by the shader hot reload thread, cullPipelineLayout is created once by createCullingPass()
+    bool createCullPipeline(VkPipeline& pipeline) {
+        ShaderCode csCode;
+        if (!loadShader("cull.comp", csCode)) return false;
+
+        VkShaderModule csShaderModule;
+        VkShaderModuleCreateInfo csShaderModuleInfo{};
+        csShaderModuleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        csShaderModuleInfo.codeSize = csCode.size;
+        csShaderModuleInfo.pCode = csCode.data();
+        if (vkCreateShaderModule(this->device, &csShaderModuleInfo, nullptr, &csShaderModule) != VK_SUCCESS) { std::cerr << "Failed to create VkShaderModule (compute)\n"; return false; }
+
+        VkPipelineCreationFeedback creationFeedback{};
+        VkPipelineCreationFeedbackCreateInfo creationFeedbackInfo{};
+        creationFeedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+        creationFeedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &creationFeedbackInfo;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = csShaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = this->cullPipelineLayout;
+
+        auto creationStart = std::chrono::steady_clock::now();
+        VkResult result = vkCreateComputePipelines(this->device, this->pipelineCache.handle(), 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(this->device, csShaderModule, nullptr);
+        if (result != VK_SUCCESS) {
+            std::cerr << "Failed to create the culling compute pipeline\n";
+            return false;
+        }
+        double creationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - creationStart).count();
+        this->pipelineCache.recordCreation("cull", creationFeedback, creationMs);
+
+        return true;
     }
 
-    void mainLoop() {
+    // Async compute: records and submits the culling of a frame on the compute queue,
+    // returns the compute timeline value its graphics submission has to wait on (0 on failure)
+    uint64_t submitCulling(uint32_t frame) {
+        VkCommandBuffer commandBuffer = this->computeCommandBuffers[frame];
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            std::cerr << "Failed to begin the compute command buffer\n";
+            return 0;
+        }
+
+        recordCulling(commandBuffer, frame);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            std::cerr << "Failed to record the compute command buffer\n";
+            return 0;
+        }
+
+        uint64_t value = this->computeTimeline.nextValue();
+
+        VkCommandBufferSubmitInfo commandBufferInfo{};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        commandBufferInfo.commandBuffer = commandBuffer;
+
+        // Signaled once the dispatch is done, which also makes its writes available to the waiting graphics queue
+        VkSemaphoreSubmitInfo signalInfo{};
+        signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        signalInfo.semaphore = this->computeTimeline.handle();
+        signalInfo.value = value;
+        signalInfo.stageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+
+        VkSubmitInfo2 submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &commandBufferInfo;
+        submitInfo.signalSemaphoreInfoCount = 1;
+        submitInfo.pSignalSemaphoreInfos = &signalInfo;
+
+        if (vkQueueSubmit2(this->computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            std::cerr << "Failed to submit to the compute queue\n";
+            return 0;
+        }
+        return value;
+    }
+
+    // A render graph pass, or recorded into the compute queue's command buffer, the indirect draw in recordDraws() consumes the result.
+    // Ordering the two is up to the graph inline, and up to the compute timeline wait async
+    void recordCulling(VkCommandBuffer commandBuffer, uint32_t frame) {
+        // No instance yet, cull.comp counts the visible ones into instanceCount
+        VkDrawIndexedIndirectCommand draw{ this->indexCount, 0, 0, 0, 0 };
+        vkCmdUpdateBuffer(commandBuffer, this->drawCommandBuffer, this->drawCommandStride * frame, sizeof(draw), &draw);
+
+        this->barriers.memoryBarrier(VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        this->barriers.flush(commandBuffer);
+
+        CullConstants constants{};
+        constants.boundingRadius = this->meshBoundingRadius;
+        constants.objectCount = this->instanceCount;
+        constants.instanceBuffer = this->instanceHandles[frame];
+        constants.visibleBuffer = this->visibleHandles[frame];
+        constants.drawCommandBuffer = this->drawCommandHandles[frame];
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullPipeline);
+        this->bindless.bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullPipelineLayout);
+        this->uniforms.bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullPipelineLayout, 1, this->frameUniformOffset);
+        vkCmdPushConstants(commandBuffer, this->cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (constants.objectCount + 63) / 64, 1, 1); // local_size_x = 64
+    }
+
+    // Zooms in and out around a fixed point, between the whole grid and a sixteenth of it,
+    // so a varying share of the instances is off screen
+    ViewConstants viewAt(float time) const {
+        float scale = 2.5f - 1.5f * std::cos(time * 0.5f);
+        const float focus[2] = { 0.3f, 0.2f };
+
+        ViewConstants view{};
+        view.offset[0] = focus[0] * (1.0f - scale);
+        view.offset[1] = focus[1] * (1.0f - scale);
+        view.scale = scale;
+        return view;
+    }
+
+    // Lays the instances out on a square grid filling the viewport, a stand-in for whatever the application would stream.
+    // Nothing here changes from frame to frame (the bobbing is animated by the shaders), so each slice is only written
+    // the first time its frame slot comes around
+    void updateInstances(uint32_t frame) {
+        if (this->instanceSliceWritten[frame]) return;
+        this->instanceSliceWritten[frame] = true;
+
+        Instance* instances = static_cast<Instance*>(this->instanceRing.data(frame));
+        uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(this->instanceCount))));
+        float cell = 2.0f / columns;
+
+        for (uint32_t i = 0; i < this->instanceCount; ++i) {
+            uint32_t column = i % columns, row = i / columns;
+            uint32_t hash = i * 2654435761u; // Knuth's multiplicative hash, a cheap stable color per instance
+
+            Instance& instance = instances[i]; // Written front to back, write-combined memory must never be read
+            instance.offset[0] = -1.0f + cell * (column + 0.5f);
+            instance.offset[1] = -1.0f + cell * (row + 0.5f);
+            instance.scale = this->instanceCount > 1 ? cell : 1.0f;
+            instance.color = this->instanceCount > 1 ? (hash | 0xFF000000u) : 0xFFFFFFFFu;
+        }
+
+        this->instanceRing.flush(frame);
+    }
+
+    /*
+        Frame graph
+        The frame's passes and what they touch, the render graph derives every barrier from it (see RenderGraph.h).
+        The swap chain image was just acquired (or, headless, its last frame is complete), so its contents don't matter and
+        it is ready once the acquire semaphore wait stage is reached, which is all its initial state has to say.
+        With async culling the draw buffers are written on the compute queue, outside the graph: the rendering pass still
+        declares its reads, but with no writer in the graph they need no barrier, the compute timeline wait orders them.
+    */
+    bool buildFrameGraph(uint32_t frame, uint32_t imageIndex, const VkCommandBuffer* secondaries, uint32_t taskCount) {
+        this->renderGraph.begin(frame);
+
+        RenderGraph::Resource backbuffer = this->renderGraph.importImage(this->swapChainImages[imageIndex], this->swapChainImageViews[imageIndex],
+            { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE },
+            this->options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+        RenderGraph::Resource drawCommands = 0, visible = 0;
+        if (this->gpuCulling) {
+            drawCommands = this->renderGraph.importBuffer(this->drawCommandBuffer);
+            visible = this->renderGraph.importBuffer(this->visibleBuffer);
+            if (!this->asyncCompute)
+                this->renderGraph.addPass("culling", [this, frame](VkCommandBuffer commandBuffer) { recordCulling(commandBuffer, frame); })
+                    .writeBuffer(drawCommands, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT)
+                    .writeBuffer(visible, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        }
+
+        RenderGraph::PassBuilder rendering = this->renderGraph.addPass("rendering",
+            [this, frame, imageIndex, secondaries, taskCount](VkCommandBuffer commandBuffer) {
+                VkRenderingAttachmentInfo colorAttachment{};
+                colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+                colorAttachment.imageView = this->swapChainImageViews[imageIndex];
+                colorAttachment.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR;
+                colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+                VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+                colorAttachment.clearValue = clearColor;
+
+                VkRenderingInfo renderingInfo{};
+                renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+                renderingInfo.renderArea.offset = { 0, 0 };
+                renderingInfo.renderArea.extent = this->extent;
+                renderingInfo.layerCount = 1;
+                renderingInfo.colorAttachmentCount = 1;
+                renderingInfo.pColorAttachments = &colorAttachment;
+                if (secondaries) renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+
+                vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                if (secondaries) vkCmdExecuteCommands(commandBuffer, taskCount, secondaries);
+                else recordDraws(commandBuffer, frame, 0, this->options.drawCount);
+                vkCmdEndRendering(commandBuffer);
+            });
+        rendering.colorAttachment(backbuffer);
+        if (this->gpuCulling)
+            rendering.readBuffer(drawCommands, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT)
+                .readBuffer(visible, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+        return this->renderGraph.compile();
+    }
+
+    // Everything recorded inside the rendering block, either into the primary buffer or, from worker threads, into a secondary one.
+    // Secondary buffers inherit no dynamic state, so the pipeline, viewport and scissor are set every time
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstDraw, uint32_t drawCount) {
+        // Record draw commands here
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->graphicsPipeline);
+
+        this->bindless.bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout);
+        this->uniforms.bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 1, this->frameUniformOffset);
+
+        VkDeviceSize vertexOffset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &this->vertexBuffer, &vertexOffset);
+        vkCmdBindIndexBuffer(commandBuffer, this->indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+        vkCmdSetViewport(commandBuffer, 0, 1, &this->viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &this->scissor);
+        DrawConstants constants{ this->instanceHandles[frame], this->gpuCulling ? this->visibleHandles[frame] : 0 };
+        vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+
+        // The culled instance count only exists on the GPU, so the draw can't be split, the first draw takes all of it
+        if (this->gpuCulling) {
+            if (firstDraw == 0 && drawCount > 0)
+                vkCmdDrawIndexedIndirect(commandBuffer, this->drawCommandBuffer, this->drawCommandStride * frame, 1, sizeof(VkDrawIndexedIndirectCommand));
+            return;
+        }
+
+        // The instances are split evenly over the draw calls, firstInstance keeps gl_InstanceIndex global
+        uint32_t totalDraws = this->options.drawCount;
+        for (uint32_t draw = firstDraw; draw < firstDraw + drawCount; ++draw) {
+            uint32_t firstInstance = static_cast<uint32_t>(uint64_t(this->instanceCount) * draw / totalDraws);
+            uint32_t endInstance = static_cast<uint32_t>(uint64_t(this->instanceCount) * (draw + 1) / totalDraws);
+            if (endInstance > firstInstance)
+                vkCmdDrawIndexed(commandBuffer, this->indexCount, endInstance - firstInstance, 0, 0, firstInstance);
+        }
+    }
+
+    // false when a frame failed, the reason is printed
+    bool mainLoop() {
         /*
             Outline of a frame
 
@@ -926,13 +1976,78 @@ private:
         */
     
         uint32_t currentFrame = 0;
+        uint64_t frameNumber = 0;
+        const bool headless = this->options.headless;
+        auto startTime = std::chrono::steady_clock::now();
+        auto lastSummaryTime = startTime;
+
+        // Uncapped means as fast as possible, any cap would defeat it
+        this->framePacer.setTargetRate(this->options.presentPolicy == PresentPolicy::Uncapped ? 0.0 : this->options.frameRateLimit);
+
+        while (headless ? frameNumber < this->options.headlessFrameCount : !glfwWindowShouldClose(window)) {
+            // Each phase is timed from the end of the previous one, see FrameStats.h
+            auto phaseStart = FrameStats::Clock::now();
+
+            // Sleeps off the rest of the frame period before any work, so the frame's input and simulation are as fresh as possible
+            this->framePacer.wait();
+            if (this->framePacer.limited()) phaseStart = this->frameStats.record(FramePhase::FrameLimiter, phaseStart);
+
+            // The value this slot signaled framesInFlight frames ago, 0 (always complete) for the first frames
+            this->graphicsTimeline.wait(this->frameTimelineValues[currentFrame]);
+            phaseStart = this->frameStats.record(FramePhase::WaitForFrame, phaseStart);
+            this->deletionQueue.collect();
+            this->hotReload.apply(this->deletionQueue); // Before anything binds a pipeline this frame
+            if (this->graphicsVariantChanged) {
+                // Built on first use only, a variant selected before is reused from the set
+                if (VkPipeline pipeline = this->graphicsVariants.select(this->graphicsVariant.constants())) this->graphicsPipeline = pipeline;
+                this->graphicsVariantChanged = false;
+            }
+            if (this->pipelineLibraryEnabled) {
+                // Link time optimized versions of the fast linked variants, finished in the background
+                this->pipelineLibrary.collect([this](uint64_t key, VkPipeline pipeline) { this->graphicsVariants.upgrade(key, pipeline, this->deletionQueue); });
+                this->graphicsPipeline = this->graphicsVariants.active();
+            }
 
-        while (!glfwWindowShouldClose(window)) {
-            vkWaitForFences(device, 1, this->inFlightFences+currentFrame, VK_TRUE, UINT64_MAX);
-            vkResetFences(device, 1, this->inFlightFences+currentFrame);
+            // Headless: the offscreen ring is sized to the frames in flight, so the wait above already guarantees the image is free
+            uint32_t imageIndex = static_cast<uint32_t>(frameNumber % this->swapChainImages.size());
+            if (!headless) {
+                VkResult acquireResult = vkAcquireNextImageKHR(this->device, this->swapChain, UINT64_MAX, this->imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
-            uint32_t imageIndex;
-            vkAcquireNextImageKHR(this->device, this->swapChain, UINT64_MAX, this->imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+                // Nothing was acquired and the semaphore won't be signaled, retry the frame with a new swap chain.
+                // SUBOPTIMAL still acquired an image, so that frame is finished and the swap chain recreated after present
+                if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+                    if (!recreateSwapChain()) return false;
+                    continue;
+                }
+                if (acquireResult != VK_SUCCESS && acquireResult != VK_SUBOPTIMAL_KHR) {
+                    std::cerr << "Failed to acquire a swap chain image on vkAcquireNextImageKHR\n";
+                    return false;
+                }
+            }
+
+            // An older frame in another slot may still render to this image (more images than frames in flight, or MAILBOX)
+            this->graphicsTimeline.wait(this->imagesInFlight[imageIndex]);
+            if (!headless) phaseStart = this->frameStats.record(FramePhase::AcquireImage, phaseStart);
+
+            // Nothing to reset: the value is only taken now, so an early continue above never leaves a slot waiting forever
+            uint64_t frameTimelineValue = this->graphicsTimeline.nextValue();
+            this->frameTimelineValues[currentFrame] = frameTimelineValue;
+            this->imagesInFlight[imageIndex] = frameTimelineValue;
+
+            // The slot's previous frame is complete, so its slices of the instance ring and of the uniform ring are free
+            float time = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+            updateInstances(currentFrame);
+            this->uniforms.begin(currentFrame);
+            if (!this->uniforms.push(FrameUniforms{ viewAt(time), time }, this->frameUniformOffset)) return false;
+            this->uniforms.flush();
+
+            // Submitted ahead of the graphics work of this frame, so it runs while the GPU still renders the previous one
+            uint64_t computeWaitValue = 0;
+            if (this->gpuCulling && this->asyncCompute) {
+                computeWaitValue = submitCulling(currentFrame);
+                if (!computeWaitValue) return false;
+            }
+            phaseStart = this->frameStats.record(FramePhase::UpdateInstances, phaseStart);
 
             vkResetCommandBuffer(this->commandBuffers[currentFrame], 0);
 
@@ -958,122 +2073,117 @@ private:
 
             if (vkBeginCommandBuffer(this->commandBuffers[currentFrame], &cmdBufferBeginInfo) != VK_SUCCESS) {
                 std::cerr << "Failed to record VkBeginCommandBuffer\n";
-                return;
+                return false;
             }
 
-            VkImageMemoryBarrier barrier{}; // Transition of Layouts
-            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.image = this->swapChainImages[imageIndex];
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            barrier.subresourceRange.baseMipLevel = 0;
-            barrier.subresourceRange.levelCount = 1;
-            barrier.subresourceRange.baseArrayLayer = 0;
-            barrier.subresourceRange.layerCount = 1;
-
-            barrier.srcAccessMask = 0;
-            barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-            vkCmdPipelineBarrier(
-                this->commandBuffers[currentFrame],
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier
-            );
-
-
-            VkRenderingAttachmentInfo colorAttachment{};
-            colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-            colorAttachment.imageView = this->swapChainImageViews[imageIndex];
-            colorAttachment.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR;
-            colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-            colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-            VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-            colorAttachment.clearValue = clearColor;
-
-            VkRenderingInfo renderingInfo{};
-            renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-            renderingInfo.renderArea.offset = { 0, 0 };
-            renderingInfo.renderArea.extent = this->extent;
-            renderingInfo.layerCount = 1;
-            renderingInfo.colorAttachmentCount = 1;
-            renderingInfo.pColorAttachments = &colorAttachment;
-
-            vkCmdBeginRendering(this->commandBuffers[currentFrame], &renderingInfo);
-
-            // Record draw commands here
-            vkCmdBindPipeline(this->commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, this->graphicsPipeline);
-
-            // bind vertex buffers, descriptor sets, and issue draw calls...
-
-            vkCmdSetViewport(this->commandBuffers[currentFrame], 0, 1, &this->viewport);
-            vkCmdSetScissor(this->commandBuffers[currentFrame], 0, 1, &this->scissor);
-
-            vkCmdDraw(this->commandBuffers[currentFrame], 3, 1, 0, 0);
-
-            vkCmdEndRendering(this->commandBuffers[currentFrame]);
-
-            //VkImageMemoryBarrier barrier{};
-            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.image = this->swapChainImages[imageIndex];  // <- The swapchain image used this frame
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            barrier.subresourceRange.baseMipLevel = 0;
-            barrier.subresourceRange.levelCount = 1;
-            barrier.subresourceRange.baseArrayLayer = 0;
-            barrier.subresourceRange.layerCount = 1;
-
-            barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-            barrier.dstAccessMask = 0;
-
-            vkCmdPipelineBarrier(
-                this->commandBuffers[currentFrame],
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier
-            );
+            const bool parallelRecording = this->options.recordThreads > 0;
+            if (parallelRecording) this->parallelRecorder.beginFrame(currentFrame);
+
+            // Also resolves the timestamps this frame slot wrote framesInFlight frames ago, its timeline value was waited above
+            this->gpuProfiler.beginFrame(this->commandBuffers[currentFrame], currentFrame);
+            uint32_t frameScope = this->gpuProfiler.beginScope(this->commandBuffers[currentFrame], currentFrame, "frame");
+
+            // Buffers uploaded since the last frame change owner here, and this submission waits for their copies
+            uint32_t acquireScope = this->gpuProfiler.beginScope(this->commandBuffers[currentFrame], currentFrame, "barrier (uploads)");
+            VkPipelineStageFlags2 uploadWaitStages;
+            uint64_t uploadWaitValue = this->uploads.recordAcquires(this->commandBuffers[currentFrame], uploadWaitStages);
+            this->gpuProfiler.endScope(this->commandBuffers[currentFrame], currentFrame, acquireScope);
+
+            // With worker threads the draws are split into a few tasks per thread (so a slow one can be balanced out),
+            // recorded into secondary buffers, and the rendering pass only executes them.
+            // They don't depend on any barrier, so they are recorded before the graph runs
+            const VkCommandBuffer* secondaries = nullptr;
+            uint32_t taskCount = 0;
+            if (parallelRecording) {
+                uint32_t drawCount = this->options.drawCount;
+                taskCount = std::min(drawCount, this->parallelRecorder.threads() * 4);
+                secondaries = this->parallelRecorder.record(currentFrame, this->surfaceFormat.format, taskCount,
+                    [&](VkCommandBuffer commandBuffer, uint32_t task) {
+                        uint32_t firstDraw = static_cast<uint32_t>(uint64_t(drawCount) * task / taskCount);
+                        uint32_t endDraw = static_cast<uint32_t>(uint64_t(drawCount) * (task + 1) / taskCount);
+                        recordDraws(commandBuffer, currentFrame, firstDraw, endDraw - firstDraw);
+                    });
+                if (!secondaries) return false;
+            }
+
+            if (!buildFrameGraph(currentFrame, imageIndex, secondaries, taskCount)) return false;
+            this->renderGraph.execute(this->commandBuffers[currentFrame], this->gpuProfiler);
+
+            this->gpuProfiler.endScope(this->commandBuffers[currentFrame], currentFrame, frameScope);
 
             if (vkEndCommandBuffer(this->commandBuffers[currentFrame]) != VK_SUCCESS) {
                 std::cerr << "Failed to record VkEndCommandBuffer\n";
-                return;
+                return false;
+            }
+            phaseStart = this->frameStats.record(FramePhase::RecordCommands, phaseStart);
+
+            // vkQueueSubmit2 gives every semaphore its own stage mask and value, binary semaphores ignore the value
+            VkSemaphoreSubmitInfo waitInfos[3]{};
+            uint32_t waitCount = 0;
+            if (!headless) { // Nothing to acquire or present when headless
+                waitInfos[waitCount].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+                waitInfos[waitCount].semaphore = this->imageAvailableSemaphores[currentFrame];
+                waitInfos[waitCount++].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+            }
+            if (uploadWaitValue) {
+                waitInfos[waitCount].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+                waitInfos[waitCount].semaphore = this->uploads.timeline().handle();
+                waitInfos[waitCount].value = uploadWaitValue;
+                waitInfos[waitCount++].stageMask = uploadWaitStages;
+            }
+            if (computeWaitValue) { // Everything before the indirect draw overlaps the async compute work
+                waitInfos[waitCount].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+                waitInfos[waitCount].semaphore = this->computeTimeline.handle();
+                waitInfos[waitCount].value = computeWaitValue;
+                waitInfos[waitCount++].stageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
             }
 
-            VkSubmitInfo submitInfo{};
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-            VkSemaphore waitSemaphores[] = { this->imageAvailableSemaphores[currentFrame] };
-            VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-            submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = waitSemaphores;
-            submitInfo.pWaitDstStageMask = waitStages;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = this->commandBuffers+currentFrame;
-            VkSemaphore signalSemaphores[] = { this->renderFinishedSemaphores[currentFrame] };
-            submitInfo.signalSemaphoreCount = 1;
-            submitInfo.pSignalSemaphores = signalSemaphores;
-
-            if (vkQueueSubmit(this->graphicsQueue, 1, &submitInfo, this->inFlightFences[currentFrame]) != VK_SUCCESS) {
+            VkSemaphoreSubmitInfo signalInfos[2]{};
+            signalInfos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            signalInfos[0].semaphore = this->graphicsTimeline.handle();
+            signalInfos[0].value = frameTimelineValue;
+            signalInfos[0].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            signalInfos[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            signalInfos[1].semaphore = headless ? VK_NULL_HANDLE : this->renderFinishedSemaphores[imageIndex];
+            signalInfos[1].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+            VkCommandBufferSubmitInfo commandBufferInfo{};
+            commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+            commandBufferInfo.commandBuffer = this->commandBuffers[currentFrame];
+
+            VkSubmitInfo2 submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+            submitInfo.waitSemaphoreInfoCount = waitCount;
+            submitInfo.pWaitSemaphoreInfos = waitInfos;
+            submitInfo.commandBufferInfoCount = 1;
+            submitInfo.pCommandBufferInfos = &commandBufferInfo;
+            submitInfo.signalSemaphoreInfoCount = headless ? 1 : 2;
+            submitInfo.pSignalSemaphoreInfos = signalInfos;
+
+            if (vkQueueSubmit2(this->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
                 std::cerr << "Failed to submit to the graphics queue on VkQueueSubmit\n";
-                return;
+                return false;
+            }
+            this->frameStats.record(FramePhase::QueueSubmit, phaseStart);
+
+            currentFrame = (currentFrame + 1) % this->framesInFlight;
+            ++frameNumber;
+
+            auto now = std::chrono::steady_clock::now();
+            if (this->options.statsInterval > 0.0f && std::chrono::duration<float>(now - lastSummaryTime).count() >= this->options.statsInterval) {
+                this->gpuProfiler.printSummary();
+                this->frameStats.printInterval();
+                this->framePacer.printInterval();
+                lastSummaryTime = now;
             }
 
+            if (headless) continue;
+
             VkPresentInfoKHR presentInfo{};
             presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
             presentInfo.waitSemaphoreCount = 1;
-            presentInfo.pWaitSemaphores = signalSemaphores;
+            presentInfo.pWaitSemaphores = &this->renderFinishedSemaphores[imageIndex];
 
             VkSwapchainKHR swapChains[] = { this->swapChain };
             presentInfo.swapchainCount = 1;
@@ -1081,46 +2191,125 @@ private:
             presentInfo.pImageIndices = &imageIndex;
             presentInfo.pResults = nullptr;
 
-            vkQueuePresentKHR(this->presentQueue, &presentInfo);
+            // Signaled once the present is done with the semaphore and the swap chain, see recreateSwapChain()
+            VkFence presentFence = VK_NULL_HANDLE;
+            VkSwapchainPresentFenceInfoEXT presentFenceInfo{};
+            presentFenceInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+            if (this->presentFences) {
+                if (!acquirePresentFence(presentFence)) return false;
+                presentFenceInfo.swapchainCount = 1;
+                presentFenceInfo.pFences = &presentFence;
+                presentInfo.pNext = &presentFenceInfo;
+            }
+
+            phaseStart = FrameStats::Clock::now(); // Don't count the summary printing above
+            VkResult presentResult = vkQueuePresentKHR(this->presentQueue, &presentInfo);
+            phaseStart = this->frameStats.record(FramePhase::QueuePresent, phaseStart);
 
-            currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+            if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR || this->framebufferResized) {
+                if (!recreateSwapChain()) return false;
+            }
+            else if (presentResult != VK_SUCCESS) {
+                std::cerr << "Failed to present on vkQueuePresentKHR\n";
+                return false;
+            }
 
             glfwPollEvents();
+            this->frameStats.record(FramePhase::PollEvents, phaseStart);
         }
 
         vkDeviceWaitIdle(this->device); // Ensures proper cleanup
+
+        this->gpuProfiler.resolveAll();
+        this->gpuProfiler.printSummary();
+        this->frameStats.printTotal();
+        this->framePacer.printTotal();
+        this->renderGraph.printStats();
+        this->pipelineLibrary.printStats();
+        this->allocator.printStats();
+        std::cout << " Uploads: " << this->uploads.uploadedBytes() << " bytes through the staging ring\n";
+        std::cout << " Uniform ring: " << this->uniforms.peakUsage() << " bytes peak per frame\n";
+
+        if (headless) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            std::cout << " Headless: rendered " << frameNumber << " frames in " << seconds << " s ("
+                << (seconds > 0.0 ? frameNumber / seconds : 0.0) << " fps)\n";
+        }
+        return true;
     }
 
     void cleanup() {
+        this->hotReload.stop(); // No pipeline may be created while the device is torn down
+        this->pipelineLibrary.destroy();
         vkDeviceWaitIdle(this->device); // Ensures proper cleanup
-
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        // Idle doesn't cover presents, the swap chain and its semaphores go last
+        if (!this->pendingPresentFences.empty())
+            vkWaitForFences(this->device, static_cast<uint32_t>(this->pendingPresentFences.size()), this->pendingPresentFences.data(), VK_TRUE, UINT64_MAX);
+        for (VkFence fence : this->pendingPresentFences) vkDestroyFence(this->device, fence, nullptr);
+        for (VkFence fence : this->freePresentFences) vkDestroyFence(this->device, fence, nullptr);
+        this->deletionQueue.flush();
+
+        for (size_t i = 0; i < this->framesInFlight; ++i) {
             vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-            vkDestroyFence(device, inFlightFences[i], nullptr);
         }
+        for (auto semaphore : renderFinishedSemaphores)
+            vkDestroySemaphore(device, semaphore, nullptr);
+        this->graphicsTimeline.destroy();
 
+        this->gpuProfiler.destroy();
+        this->renderGraph.destroy();
+        this->parallelRecorder.destroy();
         vkDestroyCommandPool(device, commandPool, nullptr);
 
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        this->graphicsVariants.destroy();
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        if (this->gpuCulling) {
+            vkDestroyPipeline(device, cullPipeline, nullptr);
+            vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+            if (this->asyncCompute) {
+                vkDestroyCommandPool(device, computeCommandPool, nullptr);
+                this->computeTimeline.destroy();
+            }
+            this->allocator.destroyBuffer(this->drawCommandBuffer, this->drawCommandMemory);
+            this->allocator.destroyBuffer(this->visibleBuffer, this->visibleMemory);
+        }
+
+        this->pipelineCache.save();
+        this->pipelineCache.destroy();
 
         for (auto imageView : swapChainImageViews)
             vkDestroyImageView(device, imageView, nullptr);
+
+        if (this->options.headless) {
+            for (size_t i = 0; i < swapChainImages.size(); ++i)
+                this->allocator.destroyImage(swapChainImages[i], offscreenImageMemory[i]);
+        }
+
+        this->bindless.destroy();
+        this->uniforms.destroy();
+        this->instanceRing.destroy();
+        this->allocator.destroyBuffer(this->vertexBuffer, this->vertexBufferMemory);
+        this->allocator.destroyBuffer(this->indexBuffer, this->indexBufferMemory);
+        this->uploads.destroy();
+
+        this->allocator.destroy();
         
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+        // Headless never enabled the WSI extensions, so their entry points must not be called at all
+        if (!this->options.headless) vkDestroySwapchainKHR(device, swapChain, nullptr);
         vkDestroyDevice(device, nullptr);
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        if (!this->options.headless) vkDestroySurfaceKHR(instance, surface, nullptr);
         vkDestroyInstance(instance, nullptr);
+
+        if (this->options.headless) return;
         glfwDestroyWindow(window);
         glfwTerminate();
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
+    AppOptions options;
+    if (!parseArguments(argc, argv, options)) return 1;
     
-    HelloTraingleApp app;
-    app.run();
-
-    return 0;
+    HelloTraingleApp app(options);
+    return app.run() ? 0 : 1;
 }
@@ -0,0 +1,210 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+
+/*
+    Multi-threaded command recording
+    Recording is pure CPU work and command pools are not thread safe, so every worker thread gets its own
+    VkCommandPool per frame in flight. Inside the dynamic rendering block the draws are split into tasks,
+    each task is recorded by some worker into a secondary command buffer, and the primary buffer stitches them
+    back together in task order with vkCmdExecuteCommands.
+
+    The pools of a frame slot are reset as a whole (vkResetCommandPool) when the slot comes around again, which is
+    cheaper than resetting individual buffers, and the secondary buffers are reused, nothing is allocated in steady state.
+
+    Usage while recording the primary:
+        recorder.beginFrame(frame);                           // Once the previous use of the slot is complete
+        const VkCommandBuffer* secondaries = recorder.record(frame, colorFormat, taskCount,
+            [&](VkCommandBuffer cmd, uint32_t task) { ... vkCmd* ... });
+        vkCmdBeginRendering(primary, &info);                  // With VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT
+        vkCmdExecuteCommands(primary, taskCount, secondaries);
+        vkCmdEndRendering(primary);
+*/
+class ParallelRecorder {
+    struct ThreadFrame {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> buffers; // Allocated on demand, reused every time this slot comes around
+        uint32_t used = 0;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t threadCount = 0;
+    std::vector<std::vector<ThreadFrame>> frames; // [frame][thread]
+    std::vector<std::thread> workers;
+
+    // Current job, type erased without allocating: the callable lives on the stack of record()
+    void (*invoke)(const void* callable, VkCommandBuffer commandBuffer, uint32_t task) = nullptr;
+    const void* callable = nullptr;
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo{};
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+    uint32_t jobFrame = 0, jobTaskCount = 0;
+    std::vector<VkCommandBuffer> results; // [task]
+    std::atomic<uint32_t> nextTask{ 0 };
+    std::atomic<bool> failed{ false };
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    uint64_t generation = 0; // Bumped for every job, workers run each generation once
+    uint32_t busyWorkers = 0;
+    bool quit = false;
+
+    bool acquireBuffer(ThreadFrame& threadFrame, VkCommandBuffer& commandBuffer) {
+        if (threadFrame.used == threadFrame.buffers.size()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = threadFrame.pool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            VkCommandBuffer allocated;
+            if (vkAllocateCommandBuffers(this->device, &allocInfo, &allocated) != VK_SUCCESS) return false;
+            threadFrame.buffers.push_back(allocated);
+        }
+        commandBuffer = threadFrame.buffers[threadFrame.used++];
+        return true;
+    }
+
+    void runTasks(uint32_t thread) {
+        ThreadFrame& threadFrame = this->frames[this->jobFrame][thread];
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &this->inheritanceInfo;
+
+        for (uint32_t task = this->nextTask++; task < this->jobTaskCount; task = this->nextTask++) {
+            VkCommandBuffer commandBuffer;
+            if (!acquireBuffer(threadFrame, commandBuffer) || vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+                this->failed = true;
+                continue;
+            }
+
+            this->invoke(this->callable, commandBuffer, task);
+
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) this->failed = true;
+            this->results[task] = commandBuffer;
+        }
+    }
+
+    void workerLoop(uint32_t thread) {
+        uint64_t seenGeneration = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wake.wait(lock, [&] { return this->quit || this->generation != seenGeneration; });
+                if (this->quit) return;
+                seenGeneration = this->generation;
+            }
+
+            runTasks(thread);
+
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (--this->busyWorkers == 0) this->done.notify_one();
+        }
+    }
+
+public:
+    // threadCount 0 picks one worker per hardware thread
+    bool create(VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount, uint32_t frameCount) {
+        this->device = device;
+        this->threadCount = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Rerecorded every frame, reset as a whole pool
+        poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+        this->frames.assign(frameCount, std::vector<ThreadFrame>(this->threadCount));
+        for (auto& threadFrames : this->frames)
+            for (auto& threadFrame : threadFrames)
+                if (vkCreateCommandPool(device, &poolInfo, nullptr, &threadFrame.pool) != VK_SUCCESS) {
+                    std::cerr << "Failed to create a recording thread VkCommandPool\n";
+                    return false;
+                }
+
+        for (uint32_t thread = 0; thread < this->threadCount; ++thread)
+            this->workers.emplace_back(&ParallelRecorder::workerLoop, this, thread);
+
+        std::cout << " Recording draws on " << this->threadCount << " thread(s)\n";
+        return true;
+    }
+
+    // Joins the workers if initialization failed before cleanup ever ran, a joinable std::thread would terminate
+    ~ParallelRecorder() { destroy(); }
+
+    // Safe to call again, the second call finds nothing left
+    void destroy() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->quit = true;
+        }
+        this->wake.notify_all();
+        for (auto& worker : this->workers) worker.join();
+        this->workers.clear();
+
+        // Destroying a pool frees its command buffers
+        for (auto& threadFrames : this->frames)
+            for (auto& threadFrame : threadFrames)
+                if (threadFrame.pool != VK_NULL_HANDLE) vkDestroyCommandPool(this->device, threadFrame.pool, nullptr);
+        this->frames.clear();
+    }
+
+    uint32_t threads() const { return this->threadCount; }
+
+    // The previous submission of this frame slot must be complete
+    void beginFrame(uint32_t frame) {
+        for (auto& threadFrame : this->frames[frame]) {
+            vkResetCommandPool(this->device, threadFrame.pool, 0);
+            threadFrame.used = 0;
+        }
+    }
+
+    // Records taskCount secondary buffers in parallel for a dynamic rendering block with a single color attachment,
+    // returns them in task order (valid until the next record() for this frame slot), nullptr if recording failed
+    template <typename Callable>
+    const VkCommandBuffer* record(uint32_t frame, VkFormat colorFormat, uint32_t taskCount, const Callable& recordTask) {
+        if (taskCount == 0) return nullptr;
+
+        this->colorFormat = colorFormat;
+        this->inheritanceRenderingInfo = {};
+        this->inheritanceRenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+        this->inheritanceRenderingInfo.colorAttachmentCount = 1;
+        this->inheritanceRenderingInfo.pColorAttachmentFormats = &this->colorFormat;
+        this->inheritanceRenderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        this->inheritanceInfo = {};
+        this->inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        this->inheritanceInfo.pNext = &this->inheritanceRenderingInfo;
+
+        this->invoke = [](const void* callable, VkCommandBuffer commandBuffer, uint32_t task) {
+            (*static_cast<const Callable*>(callable))(commandBuffer, task);
+        };
+        this->callable = &recordTask;
+        this->jobFrame = frame;
+        this->jobTaskCount = taskCount;
+        this->results.resize(taskCount); // Only grows, no allocation once the largest task count was seen
+        this->nextTask = 0;
+        this->failed = false;
+
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->busyWorkers = this->threadCount;
+            ++this->generation;
+            this->wake.notify_all();
+            this->done.wait(lock, [&] { return this->busyWorkers == 0; });
+        }
+
+        if (this->failed) {
+            std::cerr << "Failed to record secondary command buffers\n";
+            return nullptr;
+        }
+        return this->results.data();
+    }
+};
@@ -0,0 +1,207 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstring>
+
+/*
+    Persistent pipeline cache
+
+    Creating a pipeline means the driver has to translate SPIR-V into GPU machine code, which is slow.
+    A VkPipelineCache keeps the results of that work and can be serialized with vkGetPipelineCacheData,
+    so the next launch only has to look the pipelines up instead of compiling them again.
+
+    The blob is only valid for the exact device + driver that produced it. Drivers are supposed to reject
+    a foreign blob themselves, but not all of them do it gracefully, so we wrap it in our own header
+    (vendor, device, driver version and pipelineCacheUUID) and throw the file away on any mismatch.
+
+    We also remember how long each pipeline took to create on a miss (cold), which lets us report
+    how much time the cache saved on later launches.
+*/
+class PipelineCache {
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize; // Size of the vkGetPipelineCacheData blob that follows
+        uint32_t coldTimingCount; // Number of (name hash, cold ms) pairs after the blob
+    };
+
+    static constexpr char MAGIC[4] = { 'V', 'K', 'P', 'C' };
+    static constexpr uint32_t VERSION = 1;
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    std::string path;
+
+    std::unordered_map<uint64_t, double> coldCreationMs; // Pipeline name hash -> creation time without cache
+    uint32_t hits = 0, misses = 0;
+    std::mutex statsMutex; // recordCreation() is also called by the shader hot reload thread
+
+    static uint64_t hashName(const char* name) { // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for (; *name; ++name) hash = (hash ^ static_cast<uint8_t>(*name)) * 1099511628211ull;
+        return hash;
+    }
+
+    bool matchesDevice(const FileHeader& header) const {
+        return memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+            header.version == VERSION &&
+            header.vendorID == this->properties.vendorID &&
+            header.deviceID == this->properties.deviceID &&
+            header.driverVersion == this->properties.driverVersion &&
+            memcmp(header.pipelineCacheUUID, this->properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    // Reads the file written by save(), returns an empty blob if it is missing, corrupted or from another device/driver
+    std::vector<char> loadBlob() {
+        std::vector<char> blob;
+        std::ifstream file(this->path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cout << " Pipeline cache: no cache file at " << this->path << ", starting cold\n";
+            return blob;
+        }
+
+        FileHeader header{};
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || !matchesDevice(header)) {
+            std::cout << " Pipeline cache: " << this->path << " was created by another device or driver, discarding it\n";
+            return blob;
+        }
+
+        blob.resize(header.dataSize);
+        if (!file.read(blob.data(), blob.size())) { blob.clear(); return blob; }
+
+        for (uint32_t i = 0; i < header.coldTimingCount; ++i) {
+            uint64_t nameHash; double ms;
+            if (!file.read(reinterpret_cast<char*>(&nameHash), sizeof(nameHash)) ||
+                !file.read(reinterpret_cast<char*>(&ms), sizeof(ms))) break;
+            this->coldCreationMs[nameHash] = ms;
+        }
+
+        // The driver blob starts with its own VkPipelineCacheHeaderVersionOne, double check it agrees with our header
+        VkPipelineCacheHeaderVersionOne driverHeader{};
+        if (blob.size() < sizeof(driverHeader)) { blob.clear(); return blob; }
+        memcpy(&driverHeader, blob.data(), sizeof(driverHeader));
+        if (driverHeader.vendorID != this->properties.vendorID || driverHeader.deviceID != this->properties.deviceID ||
+            memcmp(driverHeader.pipelineCacheUUID, this->properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+            std::cout << " Pipeline cache: driver header mismatch, discarding it\n";
+            blob.clear();
+            this->coldCreationMs.clear();
+        }
+
+        return blob;
+    }
+
+public:
+    bool create(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path) {
+        this->device = device;
+        this->path = path;
+        vkGetPhysicalDeviceProperties(physicalDevice, &this->properties);
+
+        std::vector<char> blob = this->path.empty() ? std::vector<char>{} : loadBlob();
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = blob.size();
+        cacheInfo.pInitialData = blob.empty() ? nullptr : blob.data();
+
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &this->cache) != VK_SUCCESS) {
+            // A blob the driver chokes on should never stop us from running, retry empty
+            cacheInfo.initialDataSize = 0;
+            cacheInfo.pInitialData = nullptr;
+            this->coldCreationMs.clear();
+            if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &this->cache) != VK_SUCCESS) {
+                std::cerr << "Failed to create VkPipelineCache\n";
+                return false;
+            }
+        }
+
+        if (!blob.empty()) std::cout << " Pipeline cache: loaded " << blob.size() << " bytes from " << this->path << "\n";
+        return true;
+    }
+
+    VkPipelineCache handle() const { return this->cache; }
+
+    // Call after vkCreate*Pipelines with the VkPipelineCreationFeedback that was chained into the create info
+    void recordCreation(const char* name, const VkPipelineCreationFeedback& feedback, double milliseconds) {
+        std::lock_guard<std::mutex> lock(this->statsMutex);
+        uint64_t nameHash = hashName(name);
+        bool feedbackValid = feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
+        bool hit = feedbackValid && (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT);
+
+        std::cout << " Pipeline cache " << (hit ? "hit" : "miss") << " for '" << name << "': " << milliseconds << " ms";
+        if (!feedbackValid) std::cout << " (driver gave no creation feedback)";
+
+        auto cold = this->coldCreationMs.find(nameHash);
+        if (hit && cold != this->coldCreationMs.end())
+            std::cout << ", saved " << (cold->second - milliseconds) << " ms vs cold " << cold->second << " ms";
+        std::cout << "\n";
+
+        if (hit) ++this->hits;
+        else {
+            ++this->misses;
+            this->coldCreationMs[nameHash] = milliseconds;
+        }
+    }
+
+    // Serializes the cache next to a temporary file and renames it over the old one,
+    // so a crash mid-write can never leave a truncated cache behind
+    void save() {
+        if (this->cache == VK_NULL_HANDLE || this->path.empty()) return;
+        std::lock_guard<std::mutex> lock(this->statsMutex);
+
+        size_t dataSize = 0;
+        vkGetPipelineCacheData(this->device, this->cache, &dataSize, nullptr);
+        std::vector<char> blob(dataSize);
+        if (vkGetPipelineCacheData(this->device, this->cache, &dataSize, blob.data()) != VK_SUCCESS) {
+            std::cerr << "Failed to read back VkPipelineCache data\n";
+            return;
+        }
+
+        FileHeader header{};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.vendorID = this->properties.vendorID;
+        header.deviceID = this->properties.deviceID;
+        header.driverVersion = this->properties.driverVersion;
+        memcpy(header.pipelineCacheUUID, this->properties.pipelineCacheUUID, VK_UUID_SIZE);
+        header.dataSize = dataSize;
+        header.coldTimingCount = static_cast<uint32_t>(this->coldCreationMs.size());
+
+        std::string tempPath = this->path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) { std::cerr << "Failed to open " << tempPath << " for writing\n"; return; }
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(blob.data(), dataSize);
+            for (const auto& [nameHash, ms] : this->coldCreationMs) {
+                file.write(reinterpret_cast<const char*>(&nameHash), sizeof(nameHash));
+                file.write(reinterpret_cast<const char*>(&ms), sizeof(ms));
+            }
+
+            if (!file.flush()) { std::cerr << "Failed to write " << tempPath << "\n"; return; }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, this->path, error);
+        if (error) { std::cerr << "Failed to replace " << this->path << ": " << error.message() << "\n"; return; }
+
+        std::cout << " Pipeline cache: " << this->hits << " hit(s), " << this->misses << " miss(es), saved "
+            << dataSize << " bytes to " << this->path << "\n";
+    }
+
+    void destroy() {
+        if (this->cache != VK_NULL_HANDLE) vkDestroyPipelineCache(this->device, this->cache, nullptr);
+        this->cache = VK_NULL_HANDLE;
+    }
+};
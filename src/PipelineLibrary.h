@@ -0,0 +1,255 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#include "PipelineVariants.h"
+
+/*
+    Graphics pipeline libraries (VK_EXT_graphics_pipeline_library)
+    A monolithic vkCreateGraphicsPipelines compiles every stage, for every new combination of specialization constants,
+    which costs tens of milliseconds: a hitch when a variant is first used mid frame.
+    With the extension a pipeline is made of four separately compiled parts:
+
+        vertex input interface      vertex layout and input assembly, shared by every variant
+        pre-rasterization shaders   the vertex shader with its constants, viewport and rasterization state
+        fragment shader             the fragment shader with its constants, multisampling
+        fragment output interface   color attachment formats and blending, shared by every variant
+
+    Each part is built once per distinct set of constants of its own stage and kept. A new variant is then a fast link
+    of existing parts (microseconds when graphicsPipelineLibraryFastLinking is set), compiling only the parts never
+    needed before. A fast linked pipeline may run a little slower, so every link also queues a link time optimized one
+    (the parts retain what it needs) on a worker thread. collect() hands the optimized ones over at a frame boundary
+    to replace the fast linked pipeline, through the deletion queue like any other replaced pipeline.
+
+    Parts and links are created on the render thread, only the optimized links run on the worker.
+    Linked pipelines don't depend on their parts once created, so parts only have to outlive the links queued with them.
+*/
+class GraphicsPipelineLibrary {
+public:
+    // Creates the library for one part (a single VK_GRAPHICS_PIPELINE_LIBRARY_*_BIT_EXT), with the constants of its stage
+    using BuildPart = std::function<bool(VkGraphicsPipelineLibraryFlagsEXT part, const SpecializationConstants& constants, VkPipeline& library)>;
+
+    static constexpr uint32_t PART_COUNT = 4;
+    static constexpr VkGraphicsPipelineLibraryFlagsEXT PARTS[PART_COUNT] = {
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+    };
+
+private:
+    struct Optimized {
+        uint64_t key; // Of the variant
+        uint32_t generation; // Of the parts it was linked from
+        VkPipeline pipeline;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    BuildPart buildPart;
+    std::unordered_map<uint64_t, VkPipeline> parts[PART_COUNT]; // Keyed by the constants of the part's stage
+    uint32_t generation = 0; // Bumped by clear(), optimized links of older parts are dropped
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+    std::vector<Optimized> finished; // Optimized, not collected yet
+    std::atomic<bool> pending{ false };
+
+    uint32_t partsBuilt = 0, fastLinks = 0;
+    std::atomic<uint32_t> optimizedLinks{ 0 };
+    double partMs = 0.0, fastLinkMs = 0.0;
+    std::atomic<uint64_t> optimizedLinkUs{ 0 };
+
+    bool linkLibraries(const VkPipeline (&libraries)[PART_COUNT], bool optimize, VkPipeline& pipeline) const {
+        VkPipelineLibraryCreateInfoKHR libraryInfo{};
+        libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+        libraryInfo.libraryCount = PART_COUNT;
+        libraryInfo.pLibraries = libraries;
+
+        // Everything else comes from the parts
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &libraryInfo;
+        pipelineInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+        pipelineInfo.layout = this->layout;
+        pipelineInfo.basePipelineIndex = -1;
+        return vkCreateGraphicsPipelines(this->device, this->cache, 1, &pipelineInfo, nullptr, &pipeline) == VK_SUCCESS;
+    }
+
+    void enqueue(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->jobs.push_back(std::move(job));
+        }
+        this->wake.notify_one();
+    }
+
+    void run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wake.wait(lock, [this] { return this->stopping || !this->jobs.empty(); });
+                if (this->jobs.empty()) return; // Stopping, and everything queued is done
+                job = std::move(this->jobs.front());
+                this->jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+public:
+    // Whether the device can do it, fastLinking: whether a link is actually cheap (the slow path still works without it)
+    static bool supported(VkPhysicalDevice physicalDevice, bool& fastLinking) {
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+        bool library = false, graphicsLibrary = false;
+        for (const auto& extension : extensions) {
+            library |= strcmp(extension.extensionName, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) == 0;
+            graphicsLibrary |= strcmp(extension.extensionName, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) == 0;
+        }
+        if (!library || !graphicsLibrary) return false;
+
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+        libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &libraryFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+        VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT libraryProperties{};
+        libraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &libraryProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        fastLinking = libraryProperties.graphicsPipelineLibraryFastLinking;
+        return libraryFeatures.graphicsPipelineLibrary;
+    }
+
+    // layout: of every part, they all use the full layout so no INDEPENDENT_SETS layout is needed
+    void create(VkDevice device, VkPipelineCache cache, VkPipelineLayout layout, BuildPart buildPart) {
+        this->device = device;
+        this->cache = cache;
+        this->layout = layout;
+        this->buildPart = std::move(buildPart);
+        this->worker = std::thread(&GraphicsPipelineLibrary::run, this);
+    }
+
+    // Joins the worker if initialization failed before cleanup ever ran, a joinable std::thread would terminate
+    ~GraphicsPipelineLibrary() { destroy(); }
+
+    // Finishes the queued links first, pipelines optimized but never collected are destroyed with the parts
+    void destroy() {
+        if (!this->worker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->wake.notify_one();
+        this->worker.join();
+
+        for (const Optimized& optimized : this->finished) vkDestroyPipeline(this->device, optimized.pipeline, nullptr);
+        this->finished.clear();
+        for (auto& partMap : this->parts) {
+            for (const auto& [key, library] : partMap) vkDestroyPipeline(this->device, library, nullptr);
+            partMap.clear();
+        }
+    }
+
+    // Render thread: fast links the variant from its parts, building the ones used for the first time,
+    // and queues its link time optimized version. vertexConstants and fragmentConstants are the variant's per stage
+    bool link(uint64_t key, const SpecializationConstants& vertexConstants, const SpecializationConstants& fragmentConstants, VkPipeline& pipeline) {
+        const SpecializationConstants none;
+        const SpecializationConstants* partConstants[PART_COUNT] = { &none, &vertexConstants, &fragmentConstants, &none };
+
+        VkPipeline libraries[PART_COUNT];
+        for (uint32_t i = 0; i < PART_COUNT; ++i) {
+            uint64_t partKey = partConstants[i]->key();
+            auto found = this->parts[i].find(partKey);
+            if (found == this->parts[i].end()) {
+                auto partStart = std::chrono::steady_clock::now();
+                VkPipeline library = VK_NULL_HANDLE;
+                if (!this->buildPart(PARTS[i], *partConstants[i], library)) return false;
+                this->partMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - partStart).count();
+                ++this->partsBuilt;
+                found = this->parts[i].emplace(partKey, library).first;
+            }
+            libraries[i] = found->second;
+        }
+
+        auto linkStart = std::chrono::steady_clock::now();
+        if (!linkLibraries(libraries, false, pipeline)) {
+            std::cerr << "Failed to link a graphics pipeline from its libraries\n";
+            return false;
+        }
+        this->fastLinkMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - linkStart).count();
+        ++this->fastLinks;
+
+        uint32_t generation = this->generation;
+        enqueue([this, key, generation, libraries] {
+            auto optimizeStart = std::chrono::steady_clock::now();
+            VkPipeline optimized = VK_NULL_HANDLE;
+            if (!linkLibraries(libraries, true, optimized)) return; // The fast linked pipeline just stays
+            this->optimizedLinkUs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - optimizeStart).count());
+            ++this->optimizedLinks;
+
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->finished.push_back({ key, generation, optimized });
+            this->pending = true;
+        });
+        return true;
+    }
+
+    // Render thread, at a frame boundary: hands every optimized pipeline finished since the last call to upgrade(key, pipeline).
+    // Only tries the lock, the render loop never waits for the worker
+    void collect(const std::function<void(uint64_t key, VkPipeline pipeline)>& upgrade) {
+        if (!this->pending) return;
+        std::unique_lock<std::mutex> lock(this->mutex, std::try_to_lock);
+        if (!lock.owns_lock()) return;
+
+        for (const Optimized& optimized : this->finished) {
+            if (optimized.generation == this->generation) upgrade(optimized.key, optimized.pipeline);
+            else vkDestroyPipeline(this->device, optimized.pipeline, nullptr); // Linked from stale parts, never bound
+        }
+        this->finished.clear();
+        this->pending = false;
+    }
+
+    // Render thread: the shaders changed, every part is dropped and rebuilt on its next use.
+    // The old parts are destroyed by the worker, after the optimized links still queued with them
+    void clear() {
+        std::vector<VkPipeline> stale;
+        for (auto& partMap : this->parts) {
+            for (const auto& [key, library] : partMap) stale.push_back(library);
+            partMap.clear();
+        }
+        ++this->generation;
+        enqueue([this, stale] { for (VkPipeline library : stale) vkDestroyPipeline(this->device, library, nullptr); });
+    }
+
+    void printStats() const {
+        if (!this->fastLinks) return;
+        uint32_t optimized = this->optimizedLinks;
+        std::cout << " Pipeline library: " << this->partsBuilt << " part(s) built in " << this->partMs << " ms, "
+            << this->fastLinks << " fast link(s) averaging " << this->fastLinkMs / this->fastLinks << " ms, "
+            << optimized << " optimized link(s) averaging " << (optimized ? this->optimizedLinkUs / 1000.0 / optimized : 0.0) << " ms\n";
+    }
+};
@@ -0,0 +1,202 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+#include <initializer_list>
+#include <cstdio>
+#include <cstdint>
+
+#include "DeletionQueue.h"
+
+/*
+    Specialization constants
+    The values of the shaders' "layout(constant_id = N) const" declarations, handed to the pipeline through
+    VkSpecializationInfo. They are compile time constants to the driver: a branch on one is folded away and a loop
+    bound by one is unrolled, so a feature toggle costs nothing at runtime, unlike a branch on a uniform.
+    Every supported type (bool, int, uint, float) is 4 bytes, bools are VkBool32.
+    One set can serve every stage of a pipeline, IDs a stage doesn't declare are ignored.
+
+        SpecializationConstants constants = SpecializationConstants().set(0, true).set(1, 2u);
+        VkSpecializationInfo info = constants.info(); // Points into constants, keep it alive
+*/
+class SpecializationConstants {
+    std::vector<VkSpecializationMapEntry> entries; // Sorted by constantID, entry i at offset 4 * i
+    std::vector<uint32_t> values;
+
+public:
+    SpecializationConstants& set(uint32_t constantId, uint32_t value) {
+        size_t i = 0;
+        while (i < this->entries.size() && this->entries[i].constantID < constantId) ++i;
+        if (i == this->entries.size() || this->entries[i].constantID != constantId) {
+            this->entries.insert(this->entries.begin() + i, VkSpecializationMapEntry{ constantId, 0, sizeof(uint32_t) });
+            this->values.insert(this->values.begin() + i, 0);
+            for (size_t j = i; j < this->entries.size(); ++j) this->entries[j].offset = static_cast<uint32_t>(j * sizeof(uint32_t));
+        }
+        this->values[i] = value;
+        return *this;
+    }
+    SpecializationConstants& set(uint32_t constantId, int32_t value) { return set(constantId, static_cast<uint32_t>(value)); }
+    SpecializationConstants& set(uint32_t constantId, bool value) { return set(constantId, static_cast<uint32_t>(value ? VK_TRUE : VK_FALSE)); }
+    SpecializationConstants& set(uint32_t constantId, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return set(constantId, bits);
+    }
+
+    // Only the given constants, e.g. the ones a single stage declares
+    SpecializationConstants subset(std::initializer_list<uint32_t> constantIds) const {
+        SpecializationConstants result;
+        for (size_t i = 0; i < this->entries.size(); ++i)
+            if (std::find(constantIds.begin(), constantIds.end(), this->entries[i].constantID) != constantIds.end())
+                result.set(this->entries[i].constantID, this->values[i]);
+        return result;
+    }
+
+    // FNV-1a over the (ID, value bits) pairs, equal sets give equal keys whatever order they were set in
+    uint64_t key() const {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < this->entries.size(); ++i) {
+            uint32_t pair[2] = { this->entries[i].constantID, this->values[i] };
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pair);
+            for (size_t b = 0; b < sizeof(pair); ++b) hash = (hash ^ bytes[b]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    VkSpecializationInfo info() const {
+        VkSpecializationInfo info{};
+        info.mapEntryCount = static_cast<uint32_t>(this->entries.size());
+        info.pMapEntries = this->entries.data();
+        info.dataSize = this->values.size() * sizeof(uint32_t);
+        info.pData = this->values.data();
+        return info;
+    }
+};
+
+/*
+    Pipeline variants
+    All the pipelines built from the same shaders and state, differing only in their specialization constants.
+    Variants are keyed by SpecializationConstants::key() and built on first use, asking for a combination again
+    returns the pipeline already built, so toggling a feature back and forth never creates a pipeline twice.
+    Only the combinations actually used are ever built, instead of one GLSL file (or #define pass) per combination.
+
+    The build function creates one pipeline for a set of constants. select() is called on the render thread, which
+    records with active(). With shader hot reload the worker rebuilds the active variant with rebuild(), and replace()
+    swaps it in: every other variant was built from the old shaders, so they all go to the deletion queue and are
+    rebuilt on their next use.
+
+    build may be a fast path that is only valid on the render thread (e.g. a GraphicsPipelineLibrary link),
+    rebuild() then uses backgroundBuild, which must be self contained.
+*/
+class PipelineVariants {
+public:
+    using Build = std::function<bool(const SpecializationConstants& constants, VkPipeline& pipeline)>;
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    Build build, backgroundBuild;
+    std::unordered_map<uint64_t, VkPipeline> pipelines;
+    uint64_t activeKey = 0;
+    VkPipeline activePipeline = VK_NULL_HANDLE;
+    uint32_t builds = 0, reuses = 0;
+
+    std::mutex mutex; // Guards what the hot reload thread reads or writes
+    SpecializationConstants activeConstants;
+    std::unordered_map<VkPipeline, uint64_t> rebuilt; // Key each rebuild() result was built for, until replace() takes it
+
+public:
+    void create(VkDevice device, Build build, Build backgroundBuild = nullptr) {
+        this->device = device;
+        this->backgroundBuild = backgroundBuild ? std::move(backgroundBuild) : build;
+        this->build = std::move(build);
+    }
+
+    void destroy() {
+        for (const auto& [key, pipeline] : this->pipelines) vkDestroyPipeline(this->device, pipeline, nullptr);
+        this->pipelines.clear();
+        this->activePipeline = VK_NULL_HANDLE;
+        if (this->builds) std::cout << " Pipeline variants: " << this->builds << " built, " << this->reuses << " reused\n";
+    }
+
+    // Makes the variant for constants the active one, building it on first use. VK_NULL_HANDLE if that fails,
+    // the previous variant then stays active
+    VkPipeline select(const SpecializationConstants& constants) {
+        uint64_t key = constants.key();
+        if (this->activePipeline && key == this->activeKey) return this->activePipeline;
+
+        auto found = this->pipelines.find(key);
+        if (found != this->pipelines.end()) ++this->reuses;
+        else {
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            if (!this->build(constants, pipeline)) return VK_NULL_HANDLE;
+            found = this->pipelines.emplace(key, pipeline).first;
+            ++this->builds;
+        }
+
+        this->activeKey = key;
+        this->activePipeline = found->second;
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->activeConstants = constants;
+        return this->activePipeline;
+    }
+
+    VkPipeline active() const { return this->activePipeline; }
+    size_t size() const { return this->pipelines.size(); }
+
+    // Hot reload thread: builds the active variant from the current shader files
+    bool rebuild(VkPipeline& pipeline) {
+        SpecializationConstants constants;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            constants = this->activeConstants;
+        }
+        if (!this->backgroundBuild(constants, pipeline)) return false;
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->rebuilt[pipeline] = constants.key();
+        return true;
+    }
+
+    // Render thread, at a frame boundary: swaps a better pipeline in for a variant, e.g. the link time optimized version
+    // of a fast linked one. The replaced pipeline goes to the deletion queue
+    void upgrade(uint64_t key, VkPipeline pipeline, DeletionQueue& deletionQueue) {
+        auto found = this->pipelines.find(key);
+        if (found == this->pipelines.end()) { // Dropped by replace() meanwhile, it was never bound
+            vkDestroyPipeline(this->device, pipeline, nullptr);
+            return;
+        }
+        deletionQueue.retire(found->second);
+        if (this->activePipeline == found->second) this->activePipeline = pipeline;
+        found->second = pipeline;
+    }
+
+    // Render thread, at a frame boundary: takes a rebuild() result and retires every variant built before it
+    void replace(VkPipeline pipeline, DeletionQueue& deletionQueue) {
+        uint64_t key;
+        SpecializationConstants constants;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            key = this->rebuilt[pipeline];
+            this->rebuilt.erase(pipeline);
+            constants = this->activeConstants;
+        }
+
+        for (const auto& [oldKey, oldPipeline] : this->pipelines) deletionQueue.retire(oldPipeline);
+        this->pipelines.clear();
+        this->pipelines[key] = pipeline;
+        ++this->builds;
+
+        // Another variant was selected while the rebuild ran, build that one too or fall back to the rebuilt one
+        this->activePipeline = VK_NULL_HANDLE;
+        if (!select(constants)) {
+            this->activeKey = key;
+            this->activePipeline = pipeline;
+        }
+    }
+};
@@ -0,0 +1,463 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+#include "GpuAllocator.h"
+#include "BarrierBatch.h"
+#include "GpuProfiler.h"
+
+/*
+    Render graph
+    A frame is declared as a list of passes, each naming the images and buffers it reads and writes and how
+    (layout, stages, accesses), plus a callback recording its commands. compile() turns that into a schedule:
+
+        - Passes whose results nobody uses are culled: a pass is kept if it writes an imported resource (the swap chain
+          image, buffers the CPU or another queue consumes), is marked sideEffect(), or writes something a kept pass reads.
+        - The schedule is the declaration order of the kept passes, which is already a valid order since a pass can
+          only read what an earlier one wrote.
+        - Every transient image (created by the graph, only alive inside the frame) gets a lifetime, from its first to
+          its last pass. Transients whose lifetimes don't overlap share memory: the images are bound to the same
+          allocation, so a shadow map and a post processing target never cost VRAM at the same time.
+
+    execute() records the passes with the barriers in between, derived from the declarations: image transitions go
+    through the BarrierBatch (so the source half of each barrier is exactly the previous use, and all transitions of a
+    pass boundary are one vkCmdPipelineBarrier2), buffer hazards become one merged memory barrier per boundary,
+    and a transient taking over aliased memory waits for the last use of the image that had it before.
+
+    Transient images and their memory belong to a frame slot: frames in flight run concurrently on the GPU, so they
+    can't share them. They are only rebuilt when the transients or their lifetimes change (e.g. on resize), and
+    begin() must only be called once the slot's previous frame is complete, which the render loop waits for anyway.
+
+        graph.begin(frame);
+        auto backbuffer = graph.importImage(image, view, initialState, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        auto hdr = graph.createImage({ VK_FORMAT_R16G16B16A16_SFLOAT, extent, COLOR_ATTACHMENT | SAMPLED });
+        graph.addPass("scene", [&](VkCommandBuffer cmd) { ... }).colorAttachment(hdr);
+        graph.addPass("tonemap", [&](VkCommandBuffer cmd) { ... }).sampled(hdr, FRAGMENT_SHADER).colorAttachment(backbuffer);
+        if (graph.compile()) graph.execute(cmd, profiler);
+*/
+class RenderGraph {
+public:
+    using Resource = uint32_t;
+
+    struct ImageDesc {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent{};
+        VkImageUsageFlags usage = 0;
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+        bool operator==(const ImageDesc& other) const {
+            return this->format == other.format && this->extent.width == other.extent.width &&
+                this->extent.height == other.extent.height && this->usage == other.usage && this->aspect == other.aspect;
+        }
+    };
+
+    struct Stats {
+        uint32_t passCount = 0, culledCount = 0;
+        VkDeviceSize transientBytes = 0, aliasedBytes = 0; // Sum of the transient images' sizes, memory actually allocated
+    };
+
+private:
+    enum class Kind { ImportedImage, ImportedBuffer, TransientImage };
+
+    struct ResourceInfo {
+        Kind kind;
+        ImageDesc desc; // Transient images only
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        BarrierBatch::ImageState initialState; // Imported images only
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED; // Imported images, UNDEFINED leaves them as the last pass did
+        uint32_t transient = UINT32_MAX; // Index into the frame's transient images
+        uint32_t firstPass = UINT32_MAX, lastPass = 0; // In the schedule
+
+        // Buffer hazard tracking while executing
+        VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE, readStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+    };
+
+    struct Use {
+        Resource resource;
+        bool write;
+        VkImageLayout layout; // Ignored for buffers
+        VkPipelineStageFlags2 stages;
+        VkAccessFlags2 access;
+    };
+
+    struct Pass {
+        const char* name; // A string literal, it names the profiler scope
+        std::function<void(VkCommandBuffer)> record;
+        std::vector<Use> uses;
+        bool sideEffect = false;
+        bool culled = false;
+    };
+
+    struct TransientImage {
+        ImageDesc desc;
+        uint32_t firstPass, lastPass;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t memory = 0; // Index into FrameResources::memory
+        uint32_t previous = UINT32_MAX; // Transient that used the memory before this one in the frame
+
+        // Lifetimes are part of the identity: a different overlap means a different aliasing
+        bool sameAs(const TransientImage& other) const {
+            return this->desc == other.desc && this->firstPass == other.firstPass && this->lastPass == other.lastPass;
+        }
+    };
+
+    struct FrameResources {
+        std::vector<TransientImage> images;
+        std::vector<GpuAllocator::Allocation> memory;
+        VkDeviceSize transientBytes = 0;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    GpuAllocator* allocator = nullptr;
+    BarrierBatch* barriers = nullptr;
+    std::vector<FrameResources> frames;
+    uint32_t frame = 0;
+
+    std::vector<ResourceInfo> resources;
+    std::vector<Pass> passes;
+    std::vector<uint32_t> schedule; // Indices of the kept passes, in execution order
+    Stats statistics;
+
+    void destroyTransients(FrameResources& owned) {
+        for (auto& transient : owned.images) {
+            this->barriers->forget(transient.image);
+            if (transient.view != VK_NULL_HANDLE) vkDestroyImageView(this->device, transient.view, nullptr);
+            if (transient.image != VK_NULL_HANDLE) vkDestroyImage(this->device, transient.image, nullptr);
+        }
+        for (auto& memory : owned.memory) this->allocator->free(memory);
+        owned = FrameResources{};
+    }
+
+    // Creates the images, then packs them into as few allocations as the lifetimes allow. Greedy by first use:
+    // an image reuses the allocation whose previous user's lifetime ended before it starts, the closest in size
+    bool buildTransients(FrameResources& owned, std::vector<TransientImage>& images) {
+        struct Slot {
+            VkMemoryRequirements requirements;
+            uint32_t busyUntil, lastUser;
+        };
+        std::vector<Slot> slots;
+        std::vector<VkMemoryRequirements> requirements(images.size());
+
+        for (size_t i = 0; i < images.size(); ++i) {
+            TransientImage& transient = images[i];
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = transient.desc.format;
+            imageInfo.extent = { transient.desc.extent.width, transient.desc.extent.height, 1 };
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = transient.desc.usage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            if (vkCreateImage(this->device, &imageInfo, nullptr, &transient.image) != VK_SUCCESS) {
+                std::cerr << "Failed to create a transient render graph VkImage\n";
+                return false;
+            }
+            vkGetImageMemoryRequirements(this->device, transient.image, &requirements[i]);
+            owned.transientBytes += requirements[i].size;
+        }
+
+        std::vector<uint32_t> order(images.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return images[a].firstPass < images[b].firstPass; });
+
+        for (uint32_t i : order) {
+            TransientImage& transient = images[i];
+            const VkMemoryRequirements& required = requirements[i];
+
+            uint32_t best = UINT32_MAX;
+            for (uint32_t s = 0; s < slots.size(); ++s) {
+                const Slot& slot = slots[s];
+                if (slot.busyUntil >= transient.firstPass || !(slot.requirements.memoryTypeBits & required.memoryTypeBits)) continue;
+                auto waste = [&](const Slot& candidate) {
+                    return candidate.requirements.size > required.size ? candidate.requirements.size - required.size : required.size - candidate.requirements.size;
+                };
+                if (best == UINT32_MAX || waste(slot) < waste(slots[best])) best = s;
+            }
+
+            if (best == UINT32_MAX) {
+                best = static_cast<uint32_t>(slots.size());
+                slots.push_back({ required, 0, UINT32_MAX });
+            }
+            else {
+                VkMemoryRequirements& merged = slots[best].requirements;
+                merged.size = std::max(merged.size, required.size);
+                merged.alignment = std::max(merged.alignment, required.alignment);
+                merged.memoryTypeBits &= required.memoryTypeBits;
+            }
+            transient.memory = best;
+            transient.previous = slots[best].lastUser;
+            slots[best].busyUntil = transient.lastPass;
+            slots[best].lastUser = i;
+        }
+
+        owned.memory.resize(slots.size());
+        for (size_t s = 0; s < slots.size(); ++s)
+            if (!this->allocator->allocate(slots[s].requirements, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                GpuAllocator::ResourceKind::Optimal, owned.memory[s])) return false;
+
+        for (TransientImage& transient : images) {
+            const GpuAllocator::Allocation& memory = owned.memory[transient.memory];
+            if (vkBindImageMemory(this->device, transient.image, memory.memory, memory.offset) != VK_SUCCESS) {
+                std::cerr << "Failed to bind a transient render graph image\n";
+                return false;
+            }
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = transient.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = transient.desc.format;
+            viewInfo.subresourceRange = { transient.desc.aspect, 0, 1, 0, 1 };
+            if (vkCreateImageView(this->device, &viewInfo, nullptr, &transient.view) != VK_SUCCESS) {
+                std::cerr << "Failed to create a transient render graph VkImageView\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void bufferHazard(ResourceInfo& buffer, const Use& use) {
+        if (!use.write) {
+            // Read after write, once per write for the stages that haven't waited for it yet
+            if (buffer.writeStages != VK_PIPELINE_STAGE_2_NONE && (buffer.readStages & use.stages) != use.stages)
+                this->barriers->memoryBarrier(buffer.writeStages, buffer.writeAccess, use.stages, use.access);
+            buffer.readStages |= use.stages;
+            return;
+        }
+
+        if (buffer.readStages != VK_PIPELINE_STAGE_2_NONE) // Write after read, an execution dependency is enough
+            this->barriers->memoryBarrier(buffer.readStages, VK_ACCESS_2_NONE, use.stages, use.access);
+        else if (buffer.writeStages != VK_PIPELINE_STAGE_2_NONE) // Write after write
+            this->barriers->memoryBarrier(buffer.writeStages, buffer.writeAccess, use.stages, use.access);
+        buffer.writeStages = use.stages;
+        buffer.writeAccess = use.access;
+        buffer.readStages = VK_PIPELINE_STAGE_2_NONE;
+    }
+
+public:
+    // Holds the pass by index, a later addPass() may reallocate the pass list while a builder is still around
+    class PassBuilder {
+        RenderGraph& graph;
+        size_t index;
+
+        Pass& pass() { return this->graph.passes[this->index]; }
+
+    public:
+        PassBuilder(RenderGraph& graph, size_t index) : graph(graph), index(index) {}
+
+        PassBuilder& read(Resource resource, VkImageLayout layout, VkPipelineStageFlags2 stages, VkAccessFlags2 access) {
+            pass().uses.push_back({ resource, false, layout, stages, access });
+            return *this;
+        }
+        PassBuilder& write(Resource resource, VkImageLayout layout, VkPipelineStageFlags2 stages, VkAccessFlags2 access) {
+            pass().uses.push_back({ resource, true, layout, stages, access });
+            return *this;
+        }
+
+        // Written with loadOp CLEAR or DONT_CARE, a LOAD also reads the previous contents: add a read
+        PassBuilder& colorAttachment(Resource image) {
+            return write(image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
+        }
+        PassBuilder& depthAttachment(Resource image) {
+            return write(image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+        }
+        PassBuilder& sampled(Resource image, VkPipelineStageFlags2 stages) {
+            return read(image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, stages, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+        }
+        PassBuilder& readBuffer(Resource buffer, VkPipelineStageFlags2 stages, VkAccessFlags2 access) {
+            return read(buffer, VK_IMAGE_LAYOUT_UNDEFINED, stages, access);
+        }
+        PassBuilder& writeBuffer(Resource buffer, VkPipelineStageFlags2 stages, VkAccessFlags2 access) {
+            return write(buffer, VK_IMAGE_LAYOUT_UNDEFINED, stages, access);
+        }
+        // Never culled, for passes whose results leave the graph some other way (readbacks, queries)
+        PassBuilder& sideEffect() {
+            pass().sideEffect = true;
+            return *this;
+        }
+    };
+
+    // barriers: the command buffer's image state tracking, shared with whatever is recorded outside the graph
+    void create(VkDevice device, GpuAllocator& allocator, BarrierBatch& barriers, uint32_t frameCount) {
+        this->device = device;
+        this->allocator = &allocator;
+        this->barriers = &barriers;
+        this->frames.resize(frameCount);
+    }
+
+    void destroy() {
+        for (auto& owned : this->frames) destroyTransients(owned);
+        this->frames.clear();
+    }
+
+    // Starts declaring the frame of a slot whose previous frame is complete
+    void begin(uint32_t frame) {
+        this->frame = frame;
+        this->resources.clear();
+        this->passes.clear();
+        this->schedule.clear();
+    }
+
+    // initialState: like BarrierBatch::setState(), finalLayout: the layout the image must be left in (e.g. PRESENT_SRC)
+    Resource importImage(VkImage image, VkImageView view, const BarrierBatch::ImageState& initialState, VkImageLayout finalLayout) {
+        ResourceInfo info{ Kind::ImportedImage };
+        info.image = image;
+        info.view = view;
+        info.initialState = initialState;
+        info.finalLayout = finalLayout;
+        this->resources.push_back(info);
+        return static_cast<Resource>(this->resources.size() - 1);
+    }
+
+    // Hazards with other submissions are the semaphores' business, the graph only orders the uses inside the frame
+    Resource importBuffer(VkBuffer buffer) {
+        ResourceInfo info{ Kind::ImportedBuffer };
+        info.buffer = buffer;
+        this->resources.push_back(info);
+        return static_cast<Resource>(this->resources.size() - 1);
+    }
+
+    // Contents are undefined when its first pass starts and lost after its last one
+    Resource createImage(const ImageDesc& desc) {
+        ResourceInfo info{ Kind::TransientImage };
+        info.desc = desc;
+        this->resources.push_back(info);
+        return static_cast<Resource>(this->resources.size() - 1);
+    }
+
+    PassBuilder addPass(const char* name, std::function<void(VkCommandBuffer)> record) {
+        this->passes.push_back({ name, std::move(record) });
+        return PassBuilder(*this, this->passes.size() - 1);
+    }
+
+    // Valid after compile()
+    VkImage image(Resource resource) const { return this->resources[resource].image; }
+    VkImageView view(Resource resource) const { return this->resources[resource].view; }
+    VkBuffer buffer(Resource resource) const { return this->resources[resource].buffer; }
+
+    bool compile() {
+        // Culling, from the last pass back: what a kept pass reads has to be produced
+        std::vector<bool> needed(this->resources.size());
+        for (size_t r = 0; r < this->resources.size(); ++r) needed[r] = this->resources[r].kind != Kind::TransientImage;
+        for (size_t p = this->passes.size(); p-- > 0;) {
+            Pass& pass = this->passes[p];
+            bool kept = pass.sideEffect;
+            for (const Use& use : pass.uses) kept |= use.write && needed[use.resource];
+            pass.culled = !kept;
+            if (kept) for (const Use& use : pass.uses) if (!use.write) needed[use.resource] = true;
+        }
+
+        for (uint32_t p = 0; p < this->passes.size(); ++p) {
+            if (this->passes[p].culled) continue;
+            uint32_t position = static_cast<uint32_t>(this->schedule.size());
+            this->schedule.push_back(p);
+            for (const Use& use : this->passes[p].uses) {
+                ResourceInfo& info = this->resources[use.resource];
+                info.firstPass = std::min(info.firstPass, position);
+                info.lastPass = std::max(info.lastPass, position);
+            }
+        }
+
+        // Transients in declaration order, rebuilt only if anything about them changed since this slot's last frame
+        std::vector<TransientImage> transients;
+        for (ResourceInfo& info : this->resources) {
+            if (info.kind != Kind::TransientImage || info.firstPass == UINT32_MAX) continue; // Unused
+            info.transient = static_cast<uint32_t>(transients.size());
+            transients.push_back({ info.desc, info.firstPass, info.lastPass });
+        }
+
+        FrameResources& frameResources = this->frames[this->frame];
+        bool unchanged = transients.size() == frameResources.images.size() &&
+            std::equal(transients.begin(), transients.end(), frameResources.images.begin(),
+                [](const TransientImage& a, const TransientImage& b) { return a.sameAs(b); });
+        if (!unchanged) {
+            destroyTransients(frameResources);
+            bool built = buildTransients(frameResources, transients);
+            frameResources.images = std::move(transients); // Also on failure, so destroyTransients() finds what was created
+            if (!built) return false;
+        }
+
+        for (ResourceInfo& info : this->resources) {
+            if (info.transient == UINT32_MAX) continue;
+            info.image = frameResources.images[info.transient].image;
+            info.view = frameResources.images[info.transient].view;
+        }
+
+        this->statistics.passCount = static_cast<uint32_t>(this->passes.size());
+        this->statistics.culledCount = static_cast<uint32_t>(this->passes.size() - this->schedule.size());
+        this->statistics.transientBytes = frameResources.transientBytes;
+        this->statistics.aliasedBytes = 0;
+        for (const auto& memory : frameResources.memory) this->statistics.aliasedBytes += memory.size;
+        return true;
+    }
+
+    void execute(VkCommandBuffer commandBuffer, GpuProfiler& profiler) {
+        const FrameResources& frameResources = this->frames[this->frame];
+
+        for (ResourceInfo& info : this->resources)
+            if (info.kind == Kind::ImportedImage) this->barriers->setState(info.image, info.initialState);
+
+        for (uint32_t position = 0; position < this->schedule.size(); ++position) {
+            Pass& pass = this->passes[this->schedule[position]];
+            uint32_t scope = profiler.beginScope(commandBuffer, this->frame, pass.name);
+
+            for (const Use& use : pass.uses) {
+                ResourceInfo& info = this->resources[use.resource];
+                if (info.kind == Kind::ImportedBuffer) { bufferHazard(info, use); continue; }
+
+                // A transient starts undefined, once the image that had its memory before is done with it
+                if (info.kind == Kind::TransientImage && info.firstPass == position) {
+                    BarrierBatch::ImageState start{};
+                    uint32_t previous = frameResources.images[info.transient].previous;
+                    if (previous != UINT32_MAX)
+                        if (const BarrierBatch::ImageState* last = this->barriers->state(frameResources.images[previous].image))
+                            start = { VK_IMAGE_LAYOUT_UNDEFINED, last->stages, last->access };
+                    this->barriers->setState(info.image, start, info.desc.aspect);
+                }
+                this->barriers->transition(info.image, use.layout, use.stages, use.access);
+            }
+            this->barriers->flush(commandBuffer);
+
+            pass.record(commandBuffer);
+            profiler.endScope(commandBuffer, this->frame, scope);
+        }
+
+        // Nothing after the graph uses the images on this queue (presentation waits on a semaphore), so the destination is empty
+        bool finalTransitions = false;
+        for (ResourceInfo& info : this->resources)
+            if (info.kind == Kind::ImportedImage && info.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                this->barriers->transition(info.image, info.finalLayout, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
+                finalTransitions = true;
+            }
+        if (finalTransitions) {
+            uint32_t scope = profiler.beginScope(commandBuffer, this->frame, "barrier (final)");
+            this->barriers->flush(commandBuffer);
+            profiler.endScope(commandBuffer, this->frame, scope);
+        }
+    }
+
+    // Of the most recently compiled frame
+    const Stats& stats() const { return this->statistics; }
+
+    void printStats() const {
+        std::cout << " Render graph: " << this->statistics.passCount << " pass(es), " << this->statistics.culledCount << " culled";
+        if (this->statistics.transientBytes)
+            std::cout << ", " << (this->statistics.transientBytes >> 10) << " KiB of transient images in "
+                << (this->statistics.aliasedBytes >> 10) << " KiB of memory";
+        std::cout << "\n";
+    }
+};
@@ -0,0 +1,235 @@
+#pragma once
+#ifdef RUNTIME_SHADER_COMPILER
+#include <shaderc/shaderc.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <set>
+#include <memory>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <cstdio>
+
+#include "ShaderLibrary.h"
+
+/*
+    In-process shader compiler (development builds, -DVULKANAPP_RUNTIME_SHADER_COMPILER=ON)
+
+    Compiles GLSL from src/Shaders with shaderc directly inside the app, so editing a shader only needs a restart
+    and never a shell out to glslc per file.
+    Results go into a content addressed cache: the file name is a hash of everything that can change the output
+    (source text, stage, defines, target environment and compiler version), so an unchanged shader is never
+    compiled twice, not even across launches, and a stale entry can never be picked up by mistake.
+    #include "file" resolves next to the including file, #include <file> in the source directory. Every file a shader
+    includes, directly or not, is part of its key, so editing a shared header invalidates every shader using it.
+    The includes are found by scanning the text, a file included under a disabled #if still counts, which only costs
+    a spurious recompile.
+    The compiler version is the toolchain identity CMake passes in (SHADER_COMPILER_ID: SDK version and a hash of the
+    shaderc library), plus the SPIR-V version shaderc emits. The SPIR-V version alone stays the same across most
+    shaderc and glslang upgrades.
+*/
+class ShaderCompiler {
+public:
+    using Defines = std::vector<std::pair<std::string, std::string>>;
+
+private:
+    shaderc::Compiler compiler;
+    std::string sourceDirectory;
+    std::string cacheDirectory;
+    std::string compilerId = SHADER_COMPILER_ID;
+    uint64_t spirvVersion = 0;
+
+    static uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    static bool readFile(const std::string& path, std::string& text) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        std::stringstream stream;
+        stream << file.rdbuf();
+        text = stream.str();
+        return true;
+    }
+
+    // Name of an included file relative to the source directory, the name shaderc then reports it by
+    static std::string includeName(const std::string& requested, const std::string& requesting, bool relative) {
+        if (!relative) return requested;
+        return (std::filesystem::path(requesting).parent_path() / requested).lexically_normal().generic_string();
+    }
+
+    class Includer : public shaderc::CompileOptions::IncluderInterface {
+        struct Include {
+            std::string name, content;
+            shaderc_include_result result;
+        };
+        std::string sourceDirectory;
+
+    public:
+        explicit Includer(const std::string& sourceDirectory) : sourceDirectory(sourceDirectory) {}
+
+        shaderc_include_result* GetInclude(const char* requested, shaderc_include_type type, const char* requesting, size_t) override {
+            Include* include = new Include;
+            include->name = includeName(requested, requesting, type == shaderc_include_type_relative);
+            // An empty name tells shaderc the include failed, the content is then the error message
+            if (!readFile(this->sourceDirectory + "/" + include->name, include->content)) {
+                include->content = "Cannot open " + include->name;
+                include->name.clear();
+            }
+            include->result = { include->name.c_str(), include->name.size(), include->content.c_str(), include->content.size(), include };
+            return &include->result;
+        }
+
+        void ReleaseInclude(shaderc_include_result* result) override { delete static_cast<Include*>(result->user_data); }
+    };
+
+    // Appends the name and text of every file source includes, recursively, each once. Missing files are left
+    // for the compiler to report
+    void gatherIncludes(const std::string& name, const std::string& source, std::set<std::string>& visited, std::string& included) const {
+        std::istringstream lines(source);
+        std::string line;
+        while (std::getline(lines, line)) {
+            size_t position = line.find_first_not_of(" \t");
+            if (position == std::string::npos || line[position] != '#') continue;
+            position = line.find_first_not_of(" \t", position + 1);
+            if (position == std::string::npos || line.compare(position, 7, "include") != 0) continue;
+            position = line.find_first_not_of(" \t", position + 7);
+            if (position == std::string::npos || (line[position] != '"' && line[position] != '<')) continue;
+
+            bool relative = line[position] == '"';
+            size_t end = line.find(relative ? '"' : '>', position + 1);
+            if (end == std::string::npos) continue;
+
+            std::string includedName = includeName(line.substr(position + 1, end - position - 1), name, relative);
+            std::string text;
+            if (!visited.insert(includedName).second || !readFile(this->sourceDirectory + "/" + includedName, text)) continue;
+            included.append(includedName).push_back('\0');
+            included.append(text).push_back('\0');
+            gatherIncludes(includedName, text, visited, included);
+        }
+    }
+
+    static bool shaderKind(const std::string& name, shaderc_shader_kind& kind) {
+        std::string extension = std::filesystem::path(name).extension().string();
+        if (extension == ".vert") kind = shaderc_glsl_vertex_shader;
+        else if (extension == ".frag") kind = shaderc_glsl_fragment_shader;
+        else if (extension == ".comp") kind = shaderc_glsl_compute_shader;
+        else return false;
+        return true;
+    }
+
+    uint64_t cacheKey(const std::string& name, const std::string& source, Defines defines) const {
+        std::sort(defines.begin(), defines.end()); // Same defines in another order are the same shader
+
+        std::set<std::string> visited;
+        std::string included;
+        gatherIncludes(name, source, visited, included);
+
+        uint64_t hash = fnv1a(source.data(), source.size());
+        hash = fnv1a(included.data(), included.size(), hash);
+        hash = fnv1a(name.data(), name.size(), hash); // The extension selects the stage
+        for (const auto& [define, value] : defines) {
+            hash = fnv1a(define.data(), define.size() + 1, hash); // Include the terminator so "AB"+"C" != "A"+"BC"
+            hash = fnv1a(value.data(), value.size() + 1, hash);
+        }
+        uint32_t targetEnvironment = shaderc_env_version_vulkan_1_3;
+        hash = fnv1a(&targetEnvironment, sizeof(targetEnvironment), hash);
+        hash = fnv1a(this->compilerId.data(), this->compilerId.size() + 1, hash);
+        return fnv1a(&this->spirvVersion, sizeof(this->spirvVersion), hash);
+    }
+
+    bool readCached(const std::string& path, ShaderCode& shader) const {
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) return false;
+
+        size_t fileSize = static_cast<size_t>(file.tellg());
+        if (fileSize == 0 || fileSize % sizeof(uint32_t)) return false;
+
+        shader.loaded.resize(fileSize / sizeof(uint32_t));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(shader.loaded.data()), fileSize);
+        shader.size = fileSize;
+        return static_cast<bool>(file);
+    }
+
+    void writeCached(const std::string& path, const ShaderCode& shader) const {
+        std::error_code error;
+        std::filesystem::create_directories(this->cacheDirectory, error);
+
+        // Write then rename, a half written entry must never be mistaken for a valid one. The temporary name is unique,
+        // the render thread and the hot reload worker (or another instance of the app) may write the same entry at once
+        char suffix[48];
+        snprintf(suffix, sizeof(suffix), ".%zx.%08x.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()), std::random_device{}());
+        std::string tempPath = path + suffix;
+        bool written;
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) return;
+            file.write(reinterpret_cast<const char*>(shader.loaded.data()), shader.size);
+            written = static_cast<bool>(file.flush());
+        }
+        if (written) std::filesystem::rename(tempPath, path, error);
+        if (!written || error) std::filesystem::remove(tempPath, error);
+    }
+
+public:
+    ShaderCompiler(const std::string& sourceDirectory, const std::string& cacheDirectory)
+        : sourceDirectory(sourceDirectory), cacheDirectory(cacheDirectory) {
+        unsigned int version = 0, revision = 0;
+        shaderc_get_spv_version(&version, &revision);
+        this->spirvVersion = (static_cast<uint64_t>(version) << 32) | revision;
+    }
+
+    // Compiles "<sourceDirectory>/<name>" or takes it from the cache, thread safe (shaderc compilers can be shared)
+    bool compile(const std::string& name, const Defines& defines, ShaderCode& shader) const {
+        shader = {};
+
+        shaderc_shader_kind kind;
+        if (!shaderKind(name, kind)) { std::cerr << "Unknown shader stage for " << name << "\n"; return false; }
+
+        std::string sourcePath = this->sourceDirectory + "/" + name;
+        std::string source;
+        if (!readFile(sourcePath, source)) { std::cerr << "Failed to read shader source " << sourcePath << "\n"; return false; }
+
+        char keyText[17];
+        snprintf(keyText, sizeof(keyText), "%016llx", static_cast<unsigned long long>(cacheKey(name, source, defines)));
+        std::string cachePath = this->cacheDirectory + "/" + name + "." + keyText + ".spv";
+
+        if (readCached(cachePath, shader)) {
+            std::cout << " Shader cache hit: " << name << "\n";
+            return true;
+        }
+
+        if (!this->compiler.IsValid()) { std::cerr << "shaderc compiler is not available\n"; return false; }
+
+        shaderc::CompileOptions compileOptions;
+        compileOptions.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+        compileOptions.SetOptimizationLevel(shaderc_optimization_level_performance);
+        for (const auto& [define, value] : defines) compileOptions.AddMacroDefinition(define, value);
+        compileOptions.SetIncluder(std::make_unique<Includer>(this->sourceDirectory));
+
+        auto compileStart = std::chrono::steady_clock::now();
+        shaderc::SpvCompilationResult result = this->compiler.CompileGlslToSpv(source, kind, name.c_str(), compileOptions);
+        if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+            std::cerr << "Failed to compile " << name << ":\n" << result.GetErrorMessage();
+            return false;
+        }
+        double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+
+        shader.loaded.assign(result.cbegin(), result.cend());
+        shader.size = shader.loaded.size() * sizeof(uint32_t);
+        writeCached(cachePath, shader);
+
+        std::cout << " Shader cache miss: compiled " << name << " in " << compileMs << " ms\n";
+        return true;
+    }
+};
+#endif
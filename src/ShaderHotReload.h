@@ -0,0 +1,258 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "DeletionQueue.h"
+
+/*
+    Shader directory watcher
+    Reports the names of the files in one directory that were written since the last call.
+    Linux uses inotify: IN_CLOSE_WRITE for editors that write in place, IN_MOVED_TO for the ones that write a
+    temporary file and rename it over the original. Other platforms compare modification times a few times a second.
+    Saving a file often arrives as a burst of events, so a change is only reported once the directory has been
+    quiet for a moment, as one set.
+*/
+class ShaderWatcher {
+    static constexpr std::chrono::milliseconds SETTLE_TIME{ 50 };
+
+    std::string directory;
+#ifdef __linux__
+    int fd = -1;
+
+    // Drains the pending events, false when there were none
+    bool readEvents(std::set<std::string>& changed) {
+        alignas(inotify_event) char buffer[4096];
+        bool any = false;
+        ssize_t length;
+        while ((length = read(this->fd, buffer, sizeof(buffer))) > 0) {
+            for (char* cursor = buffer; cursor < buffer + length; ) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(cursor);
+                if (event->len && !(event->mask & IN_ISDIR)) changed.insert(event->name);
+                cursor += sizeof(inotify_event) + event->len;
+                any = true;
+            }
+        }
+        return any;
+    }
+#else
+    std::map<std::string, std::filesystem::file_time_type> writeTimes;
+
+    void scan(std::set<std::string>* changed) {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(this->directory, error)) {
+            if (!entry.is_regular_file(error)) continue;
+            std::filesystem::file_time_type time = entry.last_write_time(error);
+            if (error) continue;
+
+            std::string name = entry.path().filename().string();
+            auto known = this->writeTimes.find(name);
+            if (known != this->writeTimes.end() && known->second == time) continue;
+            this->writeTimes[name] = time;
+            if (changed) changed->insert(name);
+        }
+    }
+#endif
+
+public:
+    bool create(const std::string& directory) {
+        this->directory = directory;
+#ifdef __linux__
+        this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (this->fd < 0 || inotify_add_watch(this->fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            std::cerr << "Failed to watch " << directory << " with inotify\n";
+            return false;
+        }
+#else
+        if (!std::filesystem::is_directory(directory)) {
+            std::cerr << "Failed to watch " << directory << ", not a directory\n";
+            return false;
+        }
+        scan(nullptr); // What is there now is the baseline, not a change
+#endif
+        return true;
+    }
+
+    void destroy() {
+#ifdef __linux__
+        if (this->fd >= 0) close(this->fd);
+        this->fd = -1;
+#endif
+    }
+
+    // Waits up to timeout for a change, returns the names of the changed files, empty on timeout
+    std::set<std::string> wait(std::chrono::milliseconds timeout) {
+        std::set<std::string> changed;
+#ifdef __linux__
+        pollfd descriptor{ this->fd, POLLIN, 0 };
+        if (poll(&descriptor, 1, static_cast<int>(timeout.count())) <= 0 || !readEvents(changed)) return changed;
+        do {
+            descriptor.revents = 0;
+        } while (poll(&descriptor, 1, static_cast<int>(SETTLE_TIME.count())) > 0 && readEvents(changed));
+#else
+        std::this_thread::sleep_for(timeout);
+        scan(&changed);
+        if (changed.empty()) return changed;
+        size_t count;
+        do {
+            count = changed.size();
+            std::this_thread::sleep_for(SETTLE_TIME);
+            scan(&changed);
+        } while (changed.size() != count);
+#endif
+        return changed;
+    }
+};
+
+/*
+    Shader hot reload (--hot-reload)
+    Every pipeline is registered with the shader files it is built from and a function that builds it from scratch.
+    A worker thread watches the shader directory, and when a file changes it rebuilds every pipeline using it:
+    the build function loads (and, with the in-process compiler, compiles) the stages again and creates a new VkPipeline.
+    A file that is no stage of its own (.glsl, .h: something #included) rebuilds every pipeline.
+
+    Pipelines built from one change are published together, and the render loop swaps them in with apply() at the start
+    of a frame, so a frame never records with half of an edit. apply() only tries the lock, the render loop never waits
+    for a compile. The replaced pipelines go to the deletion queue, older frames may still be executing them.
+    A stage that fails to compile keeps the current pipeline, the compiler error is printed and the next save retries.
+
+    A pipeline that is bound through a member is registered with that member, which apply() overwrites. Anything else
+    (e.g. a PipelineVariants set) is registered with a swap function that takes the replacement over instead.
+    Build functions run on the worker thread: they may only read state that is fixed after initVulkan().
+    Pipeline creation is thread safe against the render thread, and so are VkPipelineCache and the shader compiler.
+*/
+class ShaderHotReload {
+public:
+    using Build = std::function<bool(VkPipeline& pipeline)>;
+    using Swap = std::function<void(VkPipeline pipeline, DeletionQueue& deletionQueue)>; // Called by apply(), on the render thread
+
+private:
+    struct Entry {
+        std::string name;
+        std::vector<std::string> stages; // File names, e.g. "triangle.vert"
+        Build build;
+        Swap swap;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    ShaderWatcher watcher;
+    std::vector<Entry> entries; // Fixed once the worker runs
+    std::thread worker;
+    std::atomic<bool> stopping{ false };
+
+    std::mutex mutex;
+    std::vector<std::pair<size_t, VkPipeline>> ready; // Entry index and pipeline built, not swapped in yet
+    std::atomic<bool> pending{ false };
+    uint32_t swapped = 0, failed = 0;
+
+    static bool affects(const Entry& entry, const std::string& file) {
+        for (const std::string& stage : entry.stages)
+            if (file == stage || file == stage + ".spv") return true; // Source, or SPIR-V in a --shader-dir
+        std::string extension = std::filesystem::path(file).extension().string();
+        return extension == ".glsl" || extension == ".h";
+    }
+
+    void run() {
+        while (!this->stopping) {
+            std::set<std::string> changed = this->watcher.wait(std::chrono::milliseconds(100));
+            if (changed.empty()) continue;
+
+            std::vector<std::pair<size_t, VkPipeline>> built;
+            for (size_t index = 0; index < this->entries.size(); ++index) {
+                const Entry& entry = this->entries[index];
+                if (std::none_of(changed.begin(), changed.end(), [&](const std::string& file) { return affects(entry, file); })) continue;
+
+                auto buildStart = std::chrono::steady_clock::now();
+                VkPipeline pipeline = VK_NULL_HANDLE;
+                if (!entry.build(pipeline)) {
+                    std::cerr << " Shader hot reload: rebuilding '" << entry.name << "' failed, keeping the current pipeline\n";
+                    ++this->failed;
+                    continue;
+                }
+                double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+                std::cout << " Shader hot reload: rebuilt '" << entry.name << "' in " << buildMs << " ms\n";
+                built.push_back({ index, pipeline });
+            }
+            if (built.empty()) continue;
+
+            std::lock_guard<std::mutex> lock(this->mutex);
+            for (const auto& [index, pipeline] : built) {
+                // Superseded before the render loop picked it up, it was never bound
+                auto older = std::find_if(this->ready.begin(), this->ready.end(), [&](const auto& entry) { return entry.first == index; });
+                if (older != this->ready.end()) {
+                    vkDestroyPipeline(this->device, older->second, nullptr);
+                    older->second = pipeline;
+                }
+                else this->ready.push_back({ index, pipeline });
+            }
+            this->pending = true;
+        }
+    }
+
+public:
+    // build creates a replacement from the current shader files, swap puts it in place of the old pipeline
+    void add(const std::string& name, std::vector<std::string> stages, Build build, Swap swap) {
+        this->entries.push_back({ name, std::move(stages), std::move(build), std::move(swap) });
+    }
+
+    // target is the member the render loop binds, the pipeline it held goes to the deletion queue
+    void add(const std::string& name, std::vector<std::string> stages, VkPipeline& target, Build build) {
+        add(name, std::move(stages), std::move(build), [&target](VkPipeline pipeline, DeletionQueue& deletionQueue) {
+            deletionQueue.retire(target);
+            target = pipeline;
+        });
+    }
+
+    bool start(VkDevice device, const std::string& directory) {
+        this->device = device;
+        if (!this->watcher.create(directory)) return false;
+        this->worker = std::thread(&ShaderHotReload::run, this);
+        std::cout << " Shader hot reload: watching " << directory << "\n";
+        return true;
+    }
+
+    // Stops the worker if initialization failed before cleanup ever ran, a joinable std::thread would terminate
+    ~ShaderHotReload() { stop(); }
+
+    // Before the device goes, pipelines that were built but never swapped in are destroyed
+    void stop() {
+        if (!this->worker.joinable()) return;
+        this->stopping = true;
+        this->worker.join();
+        this->watcher.destroy();
+
+        for (const auto& entry : this->ready) vkDestroyPipeline(this->device, entry.second, nullptr);
+        this->ready.clear();
+        if (this->swapped || this->failed)
+            std::cout << " Shader hot reload: " << this->swapped << " pipeline(s) swapped in, " << this->failed << " failed rebuild(s)\n";
+    }
+
+    // Swaps in the pipelines built since the last call, at a frame boundary, before anything is recorded
+    uint32_t apply(DeletionQueue& deletionQueue) {
+        if (!this->pending) return 0;
+        std::unique_lock<std::mutex> lock(this->mutex, std::try_to_lock);
+        if (!lock.owns_lock()) return 0; // The worker is publishing, next frame
+
+        for (const auto& [index, pipeline] : this->ready) this->entries[index].swap(pipeline, deletionQueue);
+        uint32_t count = static_cast<uint32_t>(this->ready.size());
+        this->swapped += count;
+        this->ready.clear();
+        this->pending = false;
+        return count;
+    }
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#include <EmbeddedShaders.h> // Generated at build time from src/Shaders (see CMakeLists.txt)
+
+/*
+    Shader code
+    SPIR-V for every shader in src/Shaders is compiled by CMake and linked into the executable,
+    so normally getting the code is just a table lookup, no process spawn and no file I/O.
+
+    For development an override directory can be given (--shader-dir or VULKANAPP_SHADER_DIR),
+    then "<dir>/<name>.spv" is read from disk instead, e.g. the output of Shaders/runtime_compile.bat.
+*/
+struct ShaderCode {
+    const uint32_t* embedded = nullptr;
+    std::vector<uint32_t> loaded; // Only filled when the code came from disk
+    size_t size = 0; // In bytes
+
+    const uint32_t* data() const { return this->loaded.empty() ? this->embedded : this->loaded.data(); }
+};
+
+inline const EmbeddedShader* findEmbeddedShader(const std::string& name) {
+    for (const auto& shader : embeddedShaders)
+        if (name == shader.name) return &shader;
+    return nullptr;
+}
+
+inline bool loadShaderCode(const std::string& name, const std::string& overrideDirectory, ShaderCode& shader) {
+    shader = {};
+
+    if (overrideDirectory.empty()) {
+        const EmbeddedShader* embedded = findEmbeddedShader(name);
+        if (!embedded) { std::cerr << "Shader " << name << " is not embedded in the executable\n"; return false; }
+
+        shader.embedded = embedded->code;
+        shader.size = embedded->size;
+        return true;
+    }
+
+    std::string path = overrideDirectory + "/" + name + ".spv";
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) { std::cerr << "Failed to read shader file " << path << "\n"; return false; }
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    if (fileSize == 0 || fileSize % sizeof(uint32_t)) { std::cerr << path << " is not valid SPIR-V\n"; return false; }
+
+    // Read straight into uint32_t storage, SPIR-V words must be 4 byte aligned for pCode
+    shader.loaded.resize(fileSize / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(shader.loaded.data()), fileSize);
+    shader.size = fileSize;
+
+    std::cout << " Loaded shader " << name << " from " << path << "\n";
+    return true;
+}
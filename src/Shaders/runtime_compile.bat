@@ -1,2 +1,3 @@
-glslc ..\..\src\Shaders\triangle.vert -o ..\..\src\Shaders\vert.spv
-glslc ..\..\src\Shaders\triangle.frag -o ..\..\src\Shaders\frag.spv
\ No newline at end of file
+glslc --target-env=vulkan1.3 %~dp0triangle.vert -o %~dp0triangle.vert.spv
+glslc --target-env=vulkan1.3 %~dp0triangle.frag -o %~dp0triangle.frag.spv
+glslc --target-env=vulkan1.3 %~dp0cull.comp -o %~dp0cull.comp.spv
\ No newline at end of file
@@ -1,6 +1,12 @@
 #version 450
+layout(location = 0) in vec3 fragColor;
 layout(location = 0) out vec4 outColor;
 
+// Specialization constants, matches ShadingModel in Main.cpp. Folded by the driver, see PipelineVariants.h
+layout(constant_id = 1) const uint SHADING_MODEL = 0; // 0 vertex colors, 1 solid, 2 grayscale
+
 void main() {
-    outColor = vec4(0.2, 0.4, 0.8, 1.0);
+    if (SHADING_MODEL == 1) outColor = vec4(0.2, 0.4, 0.8, 1.0);
+    else if (SHADING_MODEL == 2) outColor = vec4(vec3(dot(fragColor, vec3(0.2126, 0.7152, 0.0722))), 1.0);
+    else outColor = vec4(fragColor, 1.0);
 }
@@ -1,11 +1,55 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-vec4 pos[3] = vec4[](
-    vec4(0.0, -0.5, 0.0, 1.0),
-    vec4(0.5, 0.5, 0.0, 1.0),
-    vec4(-0.5, 0.5, 0.0, 1.0)
-);
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+
+// Matches struct Instance in Main.cpp
+struct Instance {
+    vec2 offset;
+    float scale;
+    uint color;
+};
+
+// Both alias the storage buffer binding of the bindless set, see BindlessDescriptors.h
+layout(std430, set = 0, binding = 1) readonly buffer Instances {
+    Instance instances[];
+} instanceBuffers[];
+
+// Indices of the instances that survived culling, written by cull.comp
+layout(std430, set = 0, binding = 1) readonly buffer VisibleInstances {
+    uint visible[];
+} visibleBuffers[];
+
+// Matches struct FrameUniforms in Main.cpp, from the uniform ring
+layout(std140, set = 1, binding = 0) uniform FrameUniforms {
+    vec2 viewOffset;
+    float viewScale;
+    float time;
+} frame;
+
+// Specialization constants, matches GraphicsVariant in Main.cpp. Folded by the driver, see PipelineVariants.h
+layout(constant_id = 0) const bool ANIMATE = false; // Spin every instance around its own center
+layout(constant_id = 2) const bool CULLED = false; // Instances are drawn through the visible list (--gpu-culling)
+
+// Matches struct DrawConstants in Main.cpp
+layout(push_constant) uniform DrawConstants {
+    uint instanceBuffer, visibleBuffer; // Bindless handles, visibleBuffer only with CULLED
+} draw;
 
 void main() {
-    gl_Position = pos[gl_VertexIndex];
+    uint index = CULLED ? visibleBuffers[draw.visibleBuffer].visible[gl_InstanceIndex] : gl_InstanceIndex;
+    Instance instance = instanceBuffers[draw.instanceBuffer].instances[index];
+    vec2 local = inPosition;
+    if (ANIMATE) {
+        float angle = frame.time + float(index) * 0.1; // Out of phase so the instances don't move as one
+        local = mat2(cos(angle), sin(angle), -sin(angle), cos(angle)) * local;
+    }
+    // The bobbing of every instance is animated here, so the CPU never rewrites the instances. Matches cull.comp
+    vec2 offset = instance.offset + vec2(0.0, 0.1 * instance.scale * sin(frame.time * 2.0 + float(index) * 0.05));
+    vec2 position = local * instance.scale + offset;
+    gl_Position = vec4(position * frame.viewScale + frame.viewOffset, 0.0, 1.0);
+    fragColor = inColor * unpackUnorm4x8(instance.color).rgb;
 }
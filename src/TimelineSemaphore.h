@@ -0,0 +1,87 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+
+/*
+    Timeline semaphore (core in Vulkan 1.2)
+    Unlike a binary semaphore or a fence, a timeline semaphore holds a 64 bit counter that only goes up.
+    Every submission to a queue signals the next value, so "has the GPU finished submission N?" is just
+    completedValue() >= N, for any N, at any time, and nothing ever has to be reset.
+
+    One per queue: all work submitted to a queue completes in submission order for our purposes,
+    so the counter of that queue tells exactly how far the GPU has come. That is what deferred deletion and
+    ring buffer reuse are keyed on.
+
+    Usage:
+        uint64_t value = timeline.nextValue();       // Signal this in the vkQueueSubmit of the frame
+        ...
+        timeline.wait(value);                         // Later, block until that submission is done
+        if (timeline.isComplete(value)) ...          // Or just poll it
+*/
+class TimelineSemaphore {
+    VkDevice device = VK_NULL_HANDLE;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    uint64_t submittedValue = 0; // Last value handed out by nextValue()
+    uint64_t completedCache = 0; // Last value read back, saves a driver call when polling older values
+
+public:
+    bool create(VkDevice device) {
+        this->device = device;
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &this->semaphore) != VK_SUCCESS) {
+            std::cerr << "Failed to create timeline VkSemaphore\n";
+            return false;
+        }
+        return true;
+    }
+
+    void destroy() {
+        if (this->semaphore != VK_NULL_HANDLE) vkDestroySemaphore(this->device, this->semaphore, nullptr);
+        this->semaphore = VK_NULL_HANDLE;
+    }
+
+    VkSemaphore handle() const { return this->semaphore; }
+
+    // The value the next submission must signal, values are only handed out once
+    uint64_t nextValue() { return ++this->submittedValue; }
+
+    // Value of the most recent submission, waiting on it means waiting for everything submitted so far
+    uint64_t lastSubmittedValue() const { return this->submittedValue; }
+
+    uint64_t completedValue() {
+        uint64_t value = 0;
+        if (vkGetSemaphoreCounterValue(this->device, this->semaphore, &value) == VK_SUCCESS)
+            this->completedCache = std::max(this->completedCache, value);
+        return this->completedCache;
+    }
+
+    bool isComplete(uint64_t value) {
+        return value <= this->completedCache || value <= completedValue();
+    }
+
+    // Value 0 is the initial value and is always complete, so waiting on a never used slot returns right away
+    bool wait(uint64_t value, uint64_t timeout = UINT64_MAX) {
+        if (value <= this->completedCache) return true;
+
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &this->semaphore;
+        waitInfo.pValues = &value;
+
+        if (vkWaitSemaphores(this->device, &waitInfo, timeout) != VK_SUCCESS) return false;
+        this->completedCache = std::max(this->completedCache, value);
+        return true;
+    }
+};
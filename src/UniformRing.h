@@ -0,0 +1,152 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+
+#include "FrameRingBuffer.h"
+
+/*
+    Transient uniform data
+    Per frame (or per draw) constants that are too large for push constants are sub-allocated from a FrameRingBuffer
+    with a bump pointer: every frame region is used front to back and starts over when its frame slot comes around again,
+    so an allocation is an add and a memcpy into mapped memory, never a vkCreateBuffer or a map/unmap.
+    A region may only be reset with begin() once the frame that last used it is complete, i.e. after the frame slot's
+    timeline value was waited, which the render loop does anyway before touching any per frame data.
+
+    Shaders see the data through a single UNIFORM_BUFFER_DYNAMIC descriptor covering maxAllocation bytes, every allocation
+    returns the dynamic offset to bind it with. Offsets are aligned to minUniformBufferOffsetAlignment.
+    The descriptor lives in its own small set: the bindless set is UPDATE_AFTER_BIND, which dynamic descriptors can't be.
+
+        uint32_t offset;
+        uniforms.begin(frame);
+        uniforms.push(frameUniforms, offset);
+        uniforms.bind(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, offset);
+*/
+class UniformRing {
+    VkDevice device = VK_NULL_HANDLE;
+    FrameRingBuffer ring;
+    VkDeviceSize alignment = 1, range = 0, regionSize = 0, bufferSize = 0;
+    VkDeviceSize cursor = 0, highWater = 0;
+    uint32_t frame = 0;
+
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+
+public:
+    // regionSize: bytes available to one frame, maxAllocation: largest single allocation (the descriptor's range)
+    // stages: every shader stage reading the uniforms, queueFamilies: see FrameRingBuffer::create()
+    bool create(VkDevice device, VkPhysicalDevice physicalDevice, GpuAllocator& allocator, VkDeviceSize regionSize, uint32_t frameCount,
+        VkDeviceSize maxAllocation, VkShaderStageFlags stages, const std::vector<uint32_t>& queueFamilies = {}) {
+        this->device = device;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        this->alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+        this->range = std::min<VkDeviceSize>({ maxAllocation, regionSize, properties.limits.maxUniformBufferRange });
+        this->regionSize = regionSize;
+
+        if (!this->ring.create(device, physicalDevice, allocator, regionSize, frameCount,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, this->alignment, queueFamilies)) return false;
+        this->bufferSize = this->ring.offset(frameCount);
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        binding.descriptorCount = 1;
+        binding.stageFlags = stages;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &this->setLayout) != VK_SUCCESS) {
+            std::cerr << "Failed to create the uniform ring VkDescriptorSetLayout\n";
+            return false;
+        }
+
+        VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 };
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &this->pool) != VK_SUCCESS) {
+            std::cerr << "Failed to create the uniform ring VkDescriptorPool\n";
+            return false;
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = this->pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &this->setLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &this->set) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate the uniform ring VkDescriptorSet\n";
+            return false;
+        }
+
+        // Written once, the dynamic offset moves the window over the whole buffer
+        VkDescriptorBufferInfo bufferInfo{ this->ring.buffer(), 0, this->range };
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = this->set;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+        return true;
+    }
+
+    void destroy() {
+        if (this->pool) vkDestroyDescriptorPool(this->device, this->pool, nullptr);
+        if (this->setLayout) vkDestroyDescriptorSetLayout(this->device, this->setLayout, nullptr);
+        this->pool = VK_NULL_HANDLE;
+        this->setLayout = VK_NULL_HANDLE;
+        this->ring.destroy();
+    }
+
+    VkDescriptorSetLayout layout() const { return this->setLayout; }
+    // Largest region use of any frame so far, to size regionSize
+    VkDeviceSize peakUsage() const { return this->highWater; }
+
+    // Starts allocating from the frame's region, whose previous frame must be complete
+    void begin(uint32_t frame) {
+        this->frame = frame;
+        this->cursor = 0;
+    }
+
+    // Returns where to write size bytes, nullptr when the region (or the descriptor's range) is too small.
+    // The descriptor covers range bytes past the offset, so near the very end of the buffer fewer bytes are available
+    void* allocate(VkDeviceSize size, uint32_t& dynamicOffset) {
+        VkDeviceSize start = (this->cursor + this->alignment - 1) & ~(this->alignment - 1);
+        VkDeviceSize offset = this->ring.offset(this->frame) + start;
+        if (size > this->range || start + size > this->regionSize || offset + this->range > this->bufferSize) {
+            std::cerr << "Uniform ring region of " << this->regionSize << " bytes is full\n";
+            return nullptr;
+        }
+
+        this->cursor = start + size;
+        this->highWater = std::max(this->highWater, this->cursor);
+        dynamicOffset = static_cast<uint32_t>(offset);
+        return static_cast<uint8_t*>(this->ring.data(0)) + offset;
+    }
+
+    template <typename T>
+    bool push(const T& value, uint32_t& dynamicOffset) {
+        void* data = allocate(sizeof(T), dynamicOffset);
+        if (!data) return false;
+        memcpy(data, &value, sizeof(T));
+        return true;
+    }
+
+    // Makes the frame's allocations visible to the device, call before submitting the frame
+    void flush() { this->ring.flush(this->frame); }
+
+    void bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t setIndex, uint32_t dynamicOffset) const {
+        vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, setIndex, 1, &this->set, 1, &dynamicOffset);
+    }
+};
@@ -0,0 +1,308 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <algorithm>
+
+#include "GpuAllocator.h"
+#include "TimelineSemaphore.h"
+
+/*
+    Uploads through a staging ring on the transfer queue
+    Device local memory is usually not host visible, so data is written into a persistently mapped staging buffer
+    and copied over by the GPU. The staging buffer is a ring: uploads take the next free bytes, and the bytes of
+    a batch come back once the transfer timeline passes the value the batch signaled. Nothing is allocated per upload,
+    and a mesh larger than the ring is simply streamed through it in chunks.
+
+    The copies go to a dedicated transfer queue family when the device has one (DMA engines copy while the graphics
+    queue keeps rendering). Buffers are EXCLUSIVE to one family, so every copied range is released by the transfer queue
+    and acquired by the graphics queue (queue family ownership transfer): recordAcquires() records the acquire half into
+    the next graphics command buffer, and that submission must wait on the returned timeline value.
+    When transfer and graphics are the same family, no barriers are needed, the semaphore wait alone orders the copy.
+
+    Usage:
+        uploads.uploadBuffer(buffer, 0, data, size, VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT);
+        uploads.submit();
+        ...
+        uint64_t wait = uploads.recordAcquires(graphicsCmd, waitStages); // Then wait on uploads.timeline() at waitStages
+*/
+class UploadQueue {
+    struct Batch {
+        VkCommandBuffer commandBuffer;
+        uint64_t value; // Transfer timeline value signaled when the batch is done
+        VkDeviceSize ringBytes; // Ring space (with alignment and wrap padding) freed when it completes
+    };
+
+    struct Acquire {
+        VkBuffer buffer;
+        VkDeviceSize offset, size;
+        VkPipelineStageFlags2 stages;
+        VkAccessFlags2 access;
+    };
+
+    static constexpr VkDeviceSize COPY_ALIGNMENT = 16; // Keeps vertex data aligned for any attribute format
+
+    VkDevice device = VK_NULL_HANDLE;
+    GpuAllocator* allocator = nullptr;
+    VkQueue queue = VK_NULL_HANDLE;
+    uint32_t transferFamily = 0, graphicsFamily = 0;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    TimelineSemaphore transferTimeline;
+
+    VkBuffer ringBuffer = VK_NULL_HANDLE;
+    GpuAllocator::Allocation ringMemory;
+    uint8_t* ringData = nullptr;
+    VkDeviceSize ringSize = 0, head = 0, used = 0;
+
+    VkCommandBuffer recording = VK_NULL_HANDLE;
+    VkDeviceSize recordingBytes = 0;
+    std::vector<VkBufferMemoryBarrier2> releases; // Recorded at the end of the batch being recorded
+    std::vector<Acquire> recordedAcquires; // Copies of the batch being recorded
+    std::vector<Acquire> submittedAcquires; // Submitted, waiting for the graphics side
+    uint64_t unacquiredValue = 0; // Latest submitted value the graphics queue has not waited on yet
+
+    std::deque<Batch> inFlight; // Oldest first
+    std::vector<VkCommandBuffer> freeCommandBuffers;
+    VkDeviceSize totalBytes = 0;
+
+    bool separateFamilies() const { return this->transferFamily != this->graphicsFamily; }
+
+    void retireCompleted() {
+        while (!this->inFlight.empty() && this->transferTimeline.isComplete(this->inFlight.front().value)) {
+            this->used -= this->inFlight.front().ringBytes;
+            this->freeCommandBuffers.push_back(this->inFlight.front().commandBuffer);
+            this->inFlight.pop_front();
+        }
+    }
+
+    // Reserves size bytes of the ring, waiting for (or first submitting) older batches when it is full
+    bool allocate(VkDeviceSize size, VkDeviceSize& offset) {
+        VkDeviceSize aligned = (this->head + COPY_ALIGNMENT - 1) & ~(COPY_ALIGNMENT - 1);
+        if (aligned + size > this->ringSize) aligned = 0; // Not enough room before the end, skip the tail and wrap
+        VkDeviceSize needed = (aligned >= this->head ? aligned - this->head : this->ringSize - this->head) + size;
+
+        while (this->ringSize - this->used < needed) {
+            retireCompleted();
+            if (this->ringSize - this->used >= needed) break;
+
+            if (!this->inFlight.empty()) this->transferTimeline.wait(this->inFlight.front().value);
+            else if (this->recordingBytes) { if (!submit()) return false; }
+            else return false; // Larger than the whole ring, callers split uploads so this can't happen
+        }
+
+        offset = aligned;
+        this->head = aligned + size;
+        this->used += needed;
+        this->recordingBytes += needed;
+        return true;
+    }
+
+    bool beginRecording() {
+        if (this->recording != VK_NULL_HANDLE) return true;
+
+        retireCompleted();
+        if (!this->freeCommandBuffers.empty()) {
+            this->recording = this->freeCommandBuffers.back();
+            this->freeCommandBuffers.pop_back();
+        }
+        else {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = this->commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(this->device, &allocInfo, &this->recording) != VK_SUCCESS) return false;
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        return vkBeginCommandBuffer(this->recording, &beginInfo) == VK_SUCCESS;
+    }
+
+public:
+    bool create(VkDevice device, GpuAllocator& allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily,
+        VkDeviceSize ringSize = 32ull << 20) {
+        this->device = device;
+        this->allocator = &allocator;
+        this->queue = transferQueue;
+        this->transferFamily = transferFamily;
+        this->graphicsFamily = graphicsFamily;
+        this->ringSize = ringSize;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = transferFamily;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &this->commandPool) != VK_SUCCESS) {
+            std::cerr << "Failed to create the upload VkCommandPool\n";
+            return false;
+        }
+
+        if (!this->transferTimeline.create(device)) return false;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = ringSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (!allocator.createBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            this->ringBuffer, this->ringMemory)) return false;
+        this->ringData = static_cast<uint8_t*>(this->ringMemory.mapped);
+
+        std::cout << " Uploads: " << (ringSize >> 20) << " MiB staging ring on queue family " << transferFamily
+            << (separateFamilies() ? " (dedicated transfer)" : " (shared with graphics)") << "\n";
+        return true;
+    }
+
+    void destroy() {
+        this->transferTimeline.wait(this->transferTimeline.lastSubmittedValue());
+        if (this->commandPool != VK_NULL_HANDLE) vkDestroyCommandPool(this->device, this->commandPool, nullptr);
+        this->commandPool = VK_NULL_HANDLE;
+        if (this->allocator) this->allocator->destroyBuffer(this->ringBuffer, this->ringMemory);
+        this->ringBuffer = VK_NULL_HANDLE;
+        this->transferTimeline.destroy();
+    }
+
+    TimelineSemaphore& timeline() { return this->transferTimeline; }
+    VkDeviceSize uploadedBytes() const { return this->totalBytes; }
+
+    // Copies size bytes into dst at dstOffset. stages/access describe the first use on the graphics queue,
+    // they become the destination of the ownership acquire
+    bool uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+        VkPipelineStageFlags2 stages, VkAccessFlags2 access) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        VkDeviceSize maxChunk = this->ringSize / 4; // Leaves room for the next chunk while the previous one is copied
+
+        for (VkDeviceSize done = 0; done < size;) {
+            VkDeviceSize chunk = std::min(size - done, maxChunk);
+            VkDeviceSize ringOffset;
+            if (!allocate(chunk, ringOffset) || !beginRecording()) {
+                std::cerr << "Failed to stage an upload of " << size << " bytes\n";
+                return false;
+            }
+
+            memcpy(this->ringData + ringOffset, bytes + done, chunk);
+            VkBufferCopy region{ ringOffset, dstOffset + done, chunk };
+            vkCmdCopyBuffer(this->recording, this->ringBuffer, dst, 1, &region);
+
+            if (separateFamilies()) {
+                VkBufferMemoryBarrier2 release{};
+                release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+                release.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+                release.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+                release.srcQueueFamilyIndex = this->transferFamily; // The destination half is ignored on the releasing queue
+                release.dstQueueFamilyIndex = this->graphicsFamily;
+                release.buffer = dst;
+                release.offset = dstOffset + done;
+                release.size = chunk;
+                this->releases.push_back(release);
+            }
+            this->recordedAcquires.push_back({ dst, dstOffset + done, chunk, stages, access });
+
+            done += chunk;
+            this->totalBytes += chunk;
+        }
+        return true;
+    }
+
+    // Submits everything recorded so far, returns false if the submission failed
+    bool submit() {
+        if (this->recording == VK_NULL_HANDLE) return true;
+
+        if (!this->releases.empty()) {
+            VkDependencyInfo dependencyInfo{};
+            dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(this->releases.size());
+            dependencyInfo.pBufferMemoryBarriers = this->releases.data();
+            vkCmdPipelineBarrier2(this->recording, &dependencyInfo);
+            this->releases.clear();
+        }
+
+        if (!this->allocator->isCoherent(this->ringMemory)) {
+            VkMappedMemoryRange range{};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = this->ringMemory.memory;
+            range.offset = this->ringMemory.offset;
+            range.size = VK_WHOLE_SIZE;
+            vkFlushMappedMemoryRanges(this->device, 1, &range);
+        }
+
+        if (vkEndCommandBuffer(this->recording) != VK_SUCCESS) {
+            std::cerr << "Failed to record the upload command buffer\n";
+            return false;
+        }
+
+        uint64_t value = this->transferTimeline.nextValue();
+
+        VkCommandBufferSubmitInfo commandBufferInfo{};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        commandBufferInfo.commandBuffer = this->recording;
+
+        VkSemaphoreSubmitInfo signalInfo{};
+        signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        signalInfo.semaphore = this->transferTimeline.handle();
+        signalInfo.value = value;
+        signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+        VkSubmitInfo2 submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &commandBufferInfo;
+        submitInfo.signalSemaphoreInfoCount = 1;
+        submitInfo.pSignalSemaphoreInfos = &signalInfo;
+
+        if (vkQueueSubmit2(this->queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            std::cerr << "Failed to submit uploads to the transfer queue\n";
+            return false;
+        }
+
+        this->inFlight.push_back({ this->recording, value, this->recordingBytes });
+        this->submittedAcquires.insert(this->submittedAcquires.end(), this->recordedAcquires.begin(), this->recordedAcquires.end());
+        this->recordedAcquires.clear();
+        this->unacquiredValue = value;
+        this->recording = VK_NULL_HANDLE;
+        this->recordingBytes = 0;
+        return true;
+    }
+
+    // Records the ownership acquires of every submitted upload into a graphics command buffer.
+    // Returns the transfer timeline value that command buffer's submission must wait on at waitStages, 0 if there is none
+    uint64_t recordAcquires(VkCommandBuffer commandBuffer, VkPipelineStageFlags2& waitStages) {
+        waitStages = VK_PIPELINE_STAGE_2_NONE;
+        if (this->unacquiredValue == 0) return 0;
+
+        std::vector<VkBufferMemoryBarrier2> acquires;
+        for (const auto& acquire : this->submittedAcquires) {
+            waitStages |= acquire.stages;
+            if (!separateFamilies()) continue;
+
+            VkBufferMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+            barrier.dstStageMask = acquire.stages; // The source half is ignored on the acquiring queue
+            barrier.dstAccessMask = acquire.access;
+            barrier.srcQueueFamilyIndex = this->transferFamily;
+            barrier.dstQueueFamilyIndex = this->graphicsFamily;
+            barrier.buffer = acquire.buffer;
+            barrier.offset = acquire.offset;
+            barrier.size = acquire.size;
+            acquires.push_back(barrier);
+        }
+
+        if (!acquires.empty()) {
+            VkDependencyInfo dependencyInfo{};
+            dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(acquires.size());
+            dependencyInfo.pBufferMemoryBarriers = acquires.data();
+            vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+        }
+
+        uint64_t value = this->unacquiredValue;
+        this->submittedAcquires.clear();
+        this->unacquiredValue = 0;
+        return value;
+    }
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdint>
+
+/*
+    Vertex layout
+    Declares how a vertex struct maps onto the vertex shader inputs, once, next to the struct,
+    and fills VkPipelineVertexInputStateCreateInfo from it so the pipeline can never disagree with the C++ side.
+
+        VertexLayout layout = VertexLayout(sizeof(Vertex))
+            .attribute(0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, position))
+            .attribute(1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color));
+
+    Per instance data goes into its own binding: .binding(sizeof(Instance), VK_VERTEX_INPUT_RATE_INSTANCE).attribute(...),
+    attributes always belong to the most recently declared binding.
+*/
+class VertexLayout {
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+
+public:
+    VertexLayout() = default;
+    explicit VertexLayout(uint32_t stride) { binding(stride); }
+
+    VertexLayout& binding(uint32_t stride, VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX) {
+        this->bindings.push_back({ static_cast<uint32_t>(this->bindings.size()), stride, inputRate });
+        return *this;
+    }
+
+    VertexLayout& attribute(uint32_t location, VkFormat format, uint32_t offset) {
+        this->attributes.push_back({ location, static_cast<uint32_t>(this->bindings.size() - 1), format, offset });
+        return *this;
+    }
+
+    // Points into this layout, which must outlive the pipeline creation
+    VkPipelineVertexInputStateCreateInfo inputState() const {
+        VkPipelineVertexInputStateCreateInfo inputInfo{};
+        inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        inputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(this->bindings.size());
+        inputInfo.pVertexBindingDescriptions = this->bindings.data();
+        inputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(this->attributes.size());
+        inputInfo.pVertexAttributeDescriptions = this->attributes.data();
+        return inputInfo;
+    }
+};